@@ -28,17 +28,26 @@
  * Copyright (C) 1995-1998 Jean-loup Gailly and Mark Adler
  */
 
-#include "tinf.h"
+#include "tinfint.h"
+
+#ifdef TINF_X86
+#  include <immintrin.h>
+#endif
+
+#ifdef TINF_NEON
+#  include <arm_neon.h>
+#endif
 
 #define A32_BASE 65521
 #define A32_NMAX 5552
 
-unsigned long tinf_adler32(const void *data, unsigned long length)
+/* Update s1 and s2 with length bytes from buf */
+static unsigned long tinf_adler32_scalar(unsigned long a32,
+                                         const unsigned char *buf,
+                                         unsigned long length)
 {
-	const unsigned char *buf = (const unsigned char *) data;
-
-	unsigned long s1 = 1;
-	unsigned long s2 = 0;
+	unsigned long s1 = a32 & 0xFFFF;
+	unsigned long s2 = a32 >> 16;
 
 	while (length > 0) {
 		long k = length < A32_NMAX ? length : A32_NMAX;
@@ -93,3 +102,234 @@ unsigned long tinf_adler32(const void *data, unsigned long length)
 
 	return (s2 << 16) | s1;
 }
+
+#if defined(TINF_X86) || defined(TINF_NEON)
+/*
+ * The vector versions below process blocks of n bytes. For a block
+ * b[0..n-1], s1 grows by the sum of the bytes, and s2 grows by n times
+ * s1 before the block plus the sum of (n - i) * b[i]. Per-lane sums of
+ * the s1 values before each block (ps), of the bytes (s1), and of the
+ * weighted bytes (s2) are kept, and reduced modulo A32_BASE after at most
+ * A32_NMAX bytes, before they can overflow.
+ */
+
+/* Combine lane sums into a32, for nb blocks of n bytes */
+static unsigned long tinf_adler32_combine(unsigned long a32, unsigned long nb,
+                                          unsigned long n, unsigned long ps,
+                                          unsigned long vs1, unsigned long vs2)
+{
+	unsigned long s1 = a32 & 0xFFFF;
+	unsigned long s2 = a32 >> 16;
+
+	s2 += (nb * n % A32_BASE) * s1 % A32_BASE;
+	s2 += (ps % A32_BASE) * n % A32_BASE;
+	s2 += vs2 % A32_BASE;
+	s1 += vs1 % A32_BASE;
+
+	return ((s2 % A32_BASE) << 16) | (s1 % A32_BASE);
+}
+#endif
+
+#ifdef TINF_X86
+/* Sum the 32-bit lanes of v */
+static __attribute__((target("ssse3"))) unsigned long
+tinf_hsum_sse(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4E));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xB1));
+
+	return (unsigned int) _mm_cvtsi128_si32(v);
+}
+
+static __attribute__((target("ssse3"))) unsigned long
+tinf_adler32_ssse3(unsigned long a32, const unsigned char *buf,
+                   unsigned long length)
+{
+	const __m128i tap = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+	                                  8, 7, 6, 5, 4, 3, 2, 1);
+	const __m128i ones = _mm_set1_epi16(1);
+	const __m128i zero = _mm_setzero_si128();
+
+	while (length >= 16) {
+		unsigned long nb = (length < A32_NMAX ? length : A32_NMAX) / 16;
+		__m128i ps = zero, s1 = zero, s2 = zero;
+		unsigned long i;
+
+		for (i = 0; i < nb; ++i, buf += 16) {
+			__m128i b = _mm_loadu_si128((const __m128i *) buf);
+
+			ps = _mm_add_epi32(ps, s1);
+			s1 = _mm_add_epi32(s1, _mm_sad_epu8(b, zero));
+			s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_maddubs_epi16(b, tap),
+			                                      ones));
+		}
+
+		a32 = tinf_adler32_combine(a32, nb, 16, tinf_hsum_sse(ps),
+		                           tinf_hsum_sse(s1), tinf_hsum_sse(s2));
+		length -= nb * 16;
+	}
+
+	return tinf_adler32_scalar(a32, buf, length);
+}
+
+/* Sum the 32-bit lanes of v */
+static __attribute__((target("avx2"))) unsigned long
+tinf_hsum_avx2(__m256i v)
+{
+	__m128i x = _mm_add_epi32(_mm256_castsi256_si128(v),
+	                          _mm256_extracti128_si256(v, 1));
+
+	x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0x4E));
+	x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0xB1));
+
+	return (unsigned int) _mm_cvtsi128_si32(x);
+}
+
+static __attribute__((target("avx2"))) unsigned long
+tinf_adler32_avx2(unsigned long a32, const unsigned char *buf,
+                  unsigned long length)
+{
+	const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+	                                     24, 23, 22, 21, 20, 19, 18, 17,
+	                                     16, 15, 14, 13, 12, 11, 10, 9,
+	                                     8, 7, 6, 5, 4, 3, 2, 1);
+	const __m256i ones = _mm256_set1_epi16(1);
+	const __m256i zero = _mm256_setzero_si256();
+
+	while (length >= 32) {
+		unsigned long nb = (length < A32_NMAX ? length : A32_NMAX) / 32;
+		__m256i ps = zero, s1 = zero, s2 = zero;
+		unsigned long i;
+
+		for (i = 0; i < nb; ++i, buf += 32) {
+			__m256i b = _mm256_loadu_si256((const __m256i *) buf);
+
+			ps = _mm256_add_epi32(ps, s1);
+			s1 = _mm256_add_epi32(s1, _mm256_sad_epu8(b, zero));
+			s2 = _mm256_add_epi32(s2,
+			        _mm256_madd_epi16(_mm256_maddubs_epi16(b, tap), ones));
+		}
+
+		a32 = tinf_adler32_combine(a32, nb, 32, tinf_hsum_avx2(ps),
+		                           tinf_hsum_avx2(s1), tinf_hsum_avx2(s2));
+		length -= nb * 32;
+	}
+
+	return tinf_adler32_ssse3(a32, buf, length);
+}
+
+/* Sum the 32-bit lanes of v */
+static __attribute__((target("avx512f,avx512bw,avx2"))) unsigned long
+tinf_hsum_avx512(__m512i v)
+{
+	return tinf_hsum_avx2(_mm256_add_epi32(_mm512_castsi512_si256(v),
+	                                       _mm512_extracti64x4_epi64(v, 1)));
+}
+
+static __attribute__((target("avx512f,avx512bw,avx2"))) unsigned long
+tinf_adler32_avx512(unsigned long a32, const unsigned char *buf,
+                    unsigned long length)
+{
+	static const unsigned char taps[64] = {
+		64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49,
+		48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33,
+		32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+		16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1
+	};
+	const __m512i tap = _mm512_loadu_si512((const void *) taps);
+	const __m512i ones = _mm512_set1_epi16(1);
+	const __m512i zero = _mm512_setzero_si512();
+
+	while (length >= 64) {
+		unsigned long nb = (length < A32_NMAX ? length : A32_NMAX) / 64;
+		__m512i ps = zero, s1 = zero, s2 = zero;
+		unsigned long i;
+
+		for (i = 0; i < nb; ++i, buf += 64) {
+			__m512i b = _mm512_loadu_si512((const void *) buf);
+
+			ps = _mm512_add_epi32(ps, s1);
+			s1 = _mm512_add_epi32(s1, _mm512_sad_epu8(b, zero));
+			s2 = _mm512_add_epi32(s2,
+			        _mm512_madd_epi16(_mm512_maddubs_epi16(b, tap), ones));
+		}
+
+		a32 = tinf_adler32_combine(a32, nb, 64, tinf_hsum_avx512(ps),
+		                           tinf_hsum_avx512(s1), tinf_hsum_avx512(s2));
+		length -= nb * 64;
+	}
+
+	return tinf_adler32_avx2(a32, buf, length);
+}
+#endif
+
+#ifdef TINF_NEON
+static unsigned long tinf_hsum_neon(uint32x4_t v)
+{
+	return vgetq_lane_u32(v, 0) + vgetq_lane_u32(v, 1)
+	     + vgetq_lane_u32(v, 2) + vgetq_lane_u32(v, 3);
+}
+
+static unsigned long tinf_adler32_neon(unsigned long a32,
+                                       const unsigned char *buf,
+                                       unsigned long length)
+{
+	static const unsigned char taps[16] = {
+		16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1
+	};
+	const uint8x16_t tap = vld1q_u8(taps);
+
+	while (length >= 16) {
+		unsigned long nb = (length < A32_NMAX ? length : A32_NMAX) / 16;
+		uint32x4_t ps = vdupq_n_u32(0);
+		uint32x4_t s1 = vdupq_n_u32(0);
+		uint32x4_t s2 = vdupq_n_u32(0);
+		unsigned long i;
+
+		for (i = 0; i < nb; ++i, buf += 16) {
+			uint8x16_t b = vld1q_u8(buf);
+
+			ps = vaddq_u32(ps, s1);
+			s1 = vpadalq_u16(s1, vpaddlq_u8(b));
+			s2 = vpadalq_u16(s2, vmull_u8(vget_low_u8(b),
+			                              vget_low_u8(tap)));
+			s2 = vpadalq_u16(s2, vmull_u8(vget_high_u8(b),
+			                              vget_high_u8(tap)));
+		}
+
+		a32 = tinf_adler32_combine(a32, nb, 16, tinf_hsum_neon(ps),
+		                           tinf_hsum_neon(s1), tinf_hsum_neon(s2));
+		length -= nb * 16;
+	}
+
+	return tinf_adler32_scalar(a32, buf, length);
+}
+#endif
+
+unsigned long tinf_adler32_update(unsigned long a32, const void *data,
+                                  unsigned long length)
+{
+	const unsigned char *buf = (const unsigned char *) data;
+
+	switch (tinf_cpu_tier()) {
+#ifdef TINF_X86
+	case TINF_CPU_AVX512:
+		return tinf_adler32_avx512(a32, buf, length);
+	case TINF_CPU_AVX2:
+		return tinf_adler32_avx2(a32, buf, length);
+	case TINF_CPU_SSE42:
+		return tinf_adler32_ssse3(a32, buf, length);
+#endif
+#ifdef TINF_NEON
+	case TINF_CPU_NEON:
+		return tinf_adler32_neon(a32, buf, length);
+#endif
+	default:
+		return tinf_adler32_scalar(a32, buf, length);
+	}
+}
+
+unsigned long tinf_adler32(const void *data, unsigned long length)
+{
+	return tinf_adler32_update(1, data, length);
+}
@@ -28,7 +28,17 @@
  * Copyright (C) 1995-1998 Jean-loup Gailly and Mark Adler
  */
 
-#include "tinf.h"
+#include "tinfint.h"
+
+#ifdef TINF_X86
+#  include <immintrin.h>
+#endif
+
+#if defined(TINF_NEON) && defined(__ARM_FEATURE_CRC32)
+#  include <arm_acle.h>
+#  include <stdint.h>
+#  include <string.h>
+#endif
 
 static const unsigned long tinf_crc32tab[16] = {
 	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190,
@@ -37,21 +47,188 @@ static const unsigned long tinf_crc32tab[16] = {
 	0xBDBDF21C
 };
 
-unsigned long tinf_crc32(const void *data, unsigned long length)
+/* Update crc (not inverted) with length bytes from buf */
+static unsigned long tinf_crc32_scalar(unsigned long crc,
+                                       const unsigned char *buf,
+                                       unsigned long length)
 {
-	const unsigned char *buf = (const unsigned char *) data;
-	unsigned long crc = 0xFFFFFFFF;
 	unsigned long i;
 
-	if (length == 0) {
-		return 0;
-	}
-
 	for (i = 0; i < length; ++i) {
 		crc ^= buf[i];
 		crc = tinf_crc32tab[crc & 0x0F] ^ (crc >> 4);
 		crc = tinf_crc32tab[crc & 0x0F] ^ (crc >> 4);
 	}
 
-	return crc ^ 0xFFFFFFFF;
+	return crc;
+}
+
+#ifdef TINF_X86
+/*
+ * Update crc (not inverted) with length bytes from buf, using carry-less
+ * multiplication to fold 64 bytes at a time. length must be at least 64
+ * and a multiple of 16.
+ *
+ * This is the algorithm from "Fast CRC Computation for Generic Polynomials
+ * Using PCLMULQDQ Instruction" by Gopal et al., with the constants for the
+ * reflected CRC-32 polynomial as used in Chromium's zlib.
+ */
+static __attribute__((target("sse4.2,pclmul"))) unsigned long
+tinf_crc32_pclmul(unsigned long crc, const unsigned char *buf,
+                  unsigned long length)
+{
+	static const long long k1k2[2] = { 0x0154442BD4LL, 0x01C6E41596LL };
+	static const long long k3k4[2] = { 0x01751997D0LL, 0x00CCAA009ELL };
+	static const long long k5k0[2] = { 0x0163CD6124LL, 0x0000000000LL };
+	static const long long poly[2] = { 0x01DB710641LL, 0x01F7011641LL };
+
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+
+	x0 = _mm_loadu_si128((const __m128i *) k1k2);
+
+	buf += 64;
+	length -= 64;
+
+	/* Fold 64 bytes at a time */
+	while (length >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+		                   _mm_loadu_si128((const __m128i *) (buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+		                   _mm_loadu_si128((const __m128i *) (buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+		                   _mm_loadu_si128((const __m128i *) (buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+		                   _mm_loadu_si128((const __m128i *) (buf + 0x30)));
+
+		buf += 64;
+		length -= 64;
+	}
+
+	/* Fold into 128 bits */
+	x0 = _mm_loadu_si128((const __m128i *) k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* Fold 16 bytes at a time */
+	while (length >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *) buf);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		buf += 16;
+		length -= 16;
+	}
+
+	/* Fold 128 bits to 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((const __m128i *) k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduce to 32 bits */
+	x0 = _mm_loadu_si128((const __m128i *) poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (unsigned int) _mm_extract_epi32(x1, 1);
+}
+#endif
+
+#if defined(TINF_NEON) && defined(__ARM_FEATURE_CRC32)
+/* Update crc (not inverted) using the ARMv8 CRC32 instructions */
+static unsigned long tinf_crc32_armv8(unsigned long crc,
+                                      const unsigned char *buf,
+                                      unsigned long length)
+{
+	uint32_t c = (uint32_t) crc;
+
+	for (; length >= 8; length -= 8, buf += 8) {
+		uint64_t v;
+
+		memcpy(&v, buf, 8);
+		c = __crc32d(c, v);
+	}
+
+	for (; length > 0; --length) {
+		c = __crc32b(c, *buf++);
+	}
+
+	return c;
+}
+#endif
+
+unsigned long tinf_crc32_update(unsigned long crc, const void *data,
+                                unsigned long length)
+{
+	const unsigned char *buf = (const unsigned char *) data;
+
+	if (length == 0) {
+		return crc;
+	}
+
+	crc ^= 0xFFFFFFFF;
+
+#ifdef TINF_X86
+	if (length >= 64 && tinf_cpu_tier() >= TINF_CPU_SSE42) {
+		unsigned long n = length & ~15UL;
+
+		crc = tinf_crc32_pclmul(crc, buf, n);
+		buf += n;
+		length -= n;
+	}
+#endif
+
+#if defined(TINF_NEON) && defined(__ARM_FEATURE_CRC32)
+	if (tinf_cpu_tier() == TINF_CPU_NEON) {
+		crc = tinf_crc32_armv8(crc, buf, length);
+		length = 0;
+	}
+#endif
+
+	return tinf_crc32_scalar(crc, buf, length) ^ 0xFFFFFFFF;
+}
+
+unsigned long tinf_crc32(const void *data, unsigned long length)
+{
+	return tinf_crc32_update(0, data, length);
 }
@@ -50,10 +50,142 @@ extern "C" {
  */
 typedef enum {
 	TINF_OK         = 0,  /**< Success */
+	TINF_OUTPUT_FULL = 1, /**< Output full, see tinf_uncompress_prefix */
 	TINF_DATA_ERROR = -3, /**< Input error */
 	TINF_BUF_ERROR  = -5  /**< Not enough room for output */
 } tinf_error_code;
 
+#ifdef TINF_BLOCK_STATS
+/**
+ * Statistics for one block of deflate data.
+ *
+ * Offsets are relative to the start of the deflate data passed to
+ * `tinf_uncompress`. Times are in units of `TINF_STATS_CLOCK()`, which
+ * defaults to a monotonic clock in nanoseconds, and can be defined when
+ * compiling tinf.
+ *
+ * Only available if tinf is compiled with `TINF_BLOCK_STATS` defined.
+ *
+ * @see tinf_set_block_callback
+ */
+struct tinf_block_stats {
+	long type;                /**< Block type (0 stored, 1 fixed, 2 dynamic) */
+	unsigned long in_start;   /**< Bit offset of block header in source */
+	unsigned long in_end;     /**< Bit offset of end of block in source */
+	unsigned long out_start;  /**< Offset of first byte of block in dest */
+	unsigned long out_end;    /**< Offset of end of block in dest */
+	unsigned long literals;   /**< Number of literals */
+	unsigned long matches;    /**< Number of matches */
+	unsigned long length_counts[29]; /**< Matches by length code - 257 */
+	unsigned long dist_counts[30];   /**< Matches by distance code */
+	unsigned long tree_time;  /**< Time spent on dynamic Huffman trees */
+	unsigned long decode_time; /**< Time spent decoding block data */
+};
+
+/**
+ * Function called by `tinf_uncompress` at the end of each block.
+ *
+ * @param stats statistics for the block
+ * @param opaque value passed to `tinf_set_block_callback`
+ */
+typedef void (TINFCC *tinf_block_callback)(const struct tinf_block_stats *stats,
+                                          void *opaque);
+
+/**
+ * Set function to call at the end of each block, or `NULL` for none.
+ *
+ * The callback is global, so set it before decompressing on any thread.
+ *
+ * Only available if tinf is compiled with `TINF_BLOCK_STATS` defined.
+ *
+ * @param cb function to call
+ * @param opaque value passed to `cb`
+ */
+void TINFCC tinf_set_block_callback(tinf_block_callback cb, void *opaque);
+#endif
+
+#ifdef TINF_COUNTERS
+/**
+ * Functions counted separately in `tinf_counters`.
+ */
+typedef enum {
+	TINF_API_UNCOMPRESS = 0, /**< tinf_uncompress */
+	TINF_API_ZLIB       = 1, /**< tinf_zlib_uncompress */
+	TINF_API_GZIP       = 2, /**< tinf_gzip_uncompress */
+	TINF_API_UNCOMPRESS_READ = 3, /**< tinf_uncompress_read */
+	TINF_API_UNCOMPRESS_WRITE = 4, /**< tinf_uncompress_write */
+	TINF_API_UNCOMPRESS_ALLOC = 5, /**< tinf_uncompress_alloc */
+	TINF_API_ZLIB_ALLOC = 6, /**< tinf_zlib_uncompress_alloc */
+	TINF_API_UNCOMPRESS_PREFIX = 7, /**< tinf_uncompress_prefix */
+	TINF_API_UNCOMPRESS2 = 8, /**< tinf_uncompress2 */
+	TINF_API_ZLIB2      = 9, /**< tinf_zlib_uncompress2 */
+	TINF_API_GZIP2      = 10, /**< tinf_gzip_uncompress2 */
+	TINF_API_UNCOMPRESS_IOV = 11, /**< tinf_uncompress_iov */
+	TINF_API_ZLIB_VERIFY = 12, /**< tinf_zlib_verify */
+	TINF_API_GZIP_VERIFY = 13, /**< tinf_gzip_verify */
+	TINF_API_UNCOMPRESS_SKIP = 14, /**< tinf_uncompress_skip */
+	TINF_API_UNCOMPRESS_WINDOW = 15, /**< tinf_uncompress_window */
+	TINF_API_ZLIB_WINDOW = 16, /**< tinf_zlib_uncompress_window */
+	TINF_API_COUNT      = 17
+} tinf_api;
+
+/**
+ * Checksums counted separately in `tinf_counters`.
+ */
+typedef enum {
+	TINF_CHECKSUM_CRC32   = 0, /**< CRC32 (gzip) */
+	TINF_CHECKSUM_ADLER32 = 1, /**< Adler-32 (zlib) */
+	TINF_CHECKSUM_COUNT   = 2
+} tinf_checksum;
+
+/**
+ * Counters for all calls to tinf since the program started.
+ *
+ * Only available if tinf is compiled with `TINF_COUNTERS` defined.
+ *
+ * @see tinf_get_counters, tinf_format_counters
+ */
+struct tinf_counters {
+	unsigned long long calls[TINF_API_COUNT];       /**< Calls */
+	unsigned long long bytes_in[TINF_API_COUNT];    /**< Source bytes */
+	unsigned long long bytes_out[TINF_API_COUNT];   /**< Bytes decompressed */
+	unsigned long long data_errors[TINF_API_COUNT]; /**< `TINF_DATA_ERROR` */
+	unsigned long long buf_errors[TINF_API_COUNT];  /**< `TINF_BUF_ERROR` */
+	unsigned long long blocks[3]; /**< Blocks by type (stored, fixed, dynamic) */
+	unsigned long long checksum_bytes[TINF_CHECKSUM_COUNT]; /**< Bytes checked */
+	unsigned long long checksum_ns[TINF_CHECKSUM_COUNT]; /**< Time checking */
+};
+
+/**
+ * Get the sum of the counters of all threads.
+ *
+ * Each thread updates its own counters, which are added up here, so
+ * counting takes no lock. The lock on the list of counters is only taken
+ * here, the first time a thread counts something, and when a thread that
+ * has counted something exits. Counts from a thread that is decompressing
+ * at the same time may be slightly behind.
+ *
+ * Only available if tinf is compiled with `TINF_COUNTERS` defined.
+ *
+ * @param c pointer to where to store counters
+ */
+void TINFCC tinf_get_counters(struct tinf_counters *c);
+
+/**
+ * Format the counters in the Prometheus text exposition format.
+ *
+ * Writes at most `size` bytes to `buf`, including a terminating zero byte,
+ * like `snprintf`.
+ *
+ * Only available if tinf is compiled with `TINF_COUNTERS` defined.
+ *
+ * @param buf pointer to where to place text
+ * @param size size of `buf`
+ * @return length of the full text, not including the terminating zero byte
+ */
+unsigned long TINFCC tinf_format_counters(char *buf, unsigned long size);
+#endif
+
 /**
  * Initialize global data used by tinf.
  *
@@ -79,6 +211,258 @@ void TINFCC tinf_init(void);
 long TINFCC tinf_uncompress(void *dest, unsigned long *destLen,
                            const void *source, unsigned long sourceLen);
 
+/**
+ * Decompress deflate data from `source` to `dest`, and report how much of
+ * `source` it used.
+ *
+ * Like `tinf_uncompress`, but `source` may continue after the deflate
+ * data, for instance with another stream. On success, `*sourceLen` is set
+ * to the number of bytes used, including the byte holding the last bit,
+ * and if `endBit` is not `NULL`, `*endBit` to the number of bits used.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen pointer to variable containing size of `source`
+ * @param endBit pointer to variable set to the number of bits used, or
+ *        `NULL`
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_uncompress2(void *dest, unsigned long *destLen,
+                            const void *source, unsigned long *sourceLen,
+                            unsigned long *endBit);
+
+/**
+ * Decompress deflate data from `source` to `dest`, until the end of the
+ * data or until `dest` is full.
+ *
+ * Like `tinf_uncompress`, but when `dest` is full, it returns
+ * `TINF_OUTPUT_FULL` instead of `TINF_BUF_ERROR`, with the first `*destLen`
+ * bytes of the decompressed data in `dest`. This is useful for looking at
+ * the start of large data. Only the input needed to fill `dest` has to be
+ * valid or present.
+ *
+ * On `TINF_OK` and `TINF_OUTPUT_FULL`, `*destLen` is set to the number of
+ * bytes placed in `dest`, and `*sourceLen` to the number of bytes of
+ * `source` that were used, including the byte holding the last bit read.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen pointer to variable containing size of compressed data
+ * @return `TINF_OK` at the end of the data, `TINF_OUTPUT_FULL` if `dest`
+ *         is full before that, error code on error
+ */
+long TINFCC tinf_uncompress_prefix(void *dest, unsigned long *destLen,
+                                  const void *source,
+                                  unsigned long *sourceLen);
+
+/**
+ * Function called by `tinf_uncompress_read` to get more input.
+ *
+ * @param buf pointer to where to place input
+ * @param size size of `buf`
+ * @param opaque value passed to `tinf_uncompress_read`
+ * @return number of bytes placed in `buf`, zero or negative at end of
+ *         input or on error
+ */
+typedef long (TINFCC *tinf_read_callback)(void *buf, unsigned long size,
+                                         void *opaque);
+
+/**
+ * Decompress deflate data read with `read` to `dest`.
+ *
+ * Like `tinf_uncompress`, but instead of taking all compressed data in
+ * one buffer, input is read in small pieces into a buffer on the stack,
+ * so data can be decompressed directly from a file or socket.
+ *
+ * `read` is called until the end of the deflate data is found or it
+ * returns zero or less. tinf may have read past the end of the deflate
+ * data when it returns.
+ *
+ * If a stored block is both truncated and too large for `dest`, this
+ * returns `TINF_BUF_ERROR`, where `tinf_uncompress` returns
+ * `TINF_DATA_ERROR`.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param read function to call for more input
+ * @param opaque value passed to `read`
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_uncompress_read(void *dest, unsigned long *destLen,
+                                tinf_read_callback read, void *opaque);
+
+/**
+ * Function called by `tinf_uncompress_write` with decompressed data.
+ *
+ * @param buf pointer to decompressed data
+ * @param size size of data
+ * @param opaque value passed to `tinf_uncompress_write`
+ * @return zero on success, non-zero to stop decompressing
+ */
+typedef long (TINFCC *tinf_write_callback)(const void *buf, unsigned long size,
+                                          void *opaque);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source`, passing the
+ * decompressed data to `write`.
+ *
+ * Like `tinf_uncompress`, but instead of needing a buffer for all of the
+ * decompressed data, it uses a 64 KiB window on the stack (33 KiB in the
+ * small profile). When the window fills, it is passed to `write`, and the
+ * last 32 KiB are kept for matches to refer to.
+ *
+ * If tinf is compiled with `TINF_RING` defined, the window is instead a
+ * 256 KiB memfd mapped twice in a row, so the last 32 KiB do not have to
+ * be moved when it is passed to `write`. The stack window is used if the
+ * mapping fails. Each thread keeps its ring for later calls until it
+ * exits, so only the first call on a thread pays for mapping it.
+ *
+ * If `write` returns non-zero, this stops and returns `TINF_BUF_ERROR`.
+ *
+ * @param write function to call with decompressed data
+ * @param opaque value passed to `write`
+ * @param destLen pointer to variable set to the size of the decompressed
+ *        data on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_uncompress_write(tinf_write_callback write, void *opaque,
+                                 unsigned long *destLen,
+                                 const void *source, unsigned long sourceLen);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source`, passing the
+ * decompressed data after the first `skip` bytes to `write`.
+ *
+ * Like `tinf_uncompress_write`, but for reading from an offset in the
+ * decompressed data. Deflate data has to be decompressed from the start,
+ * but the first `skip` bytes are only kept in the window until matches can
+ * no longer refer to them, and not passed to `write`. Stored blocks are
+ * only copied from 32 KiB before their end or `skip`, whichever is first.
+ *
+ * To stop after the data needed, return non-zero from `write`, which makes
+ * this return `TINF_BUF_ERROR`.
+ *
+ * @param write function to call with decompressed data
+ * @param opaque value passed to `write`
+ * @param skip number of bytes of decompressed data to skip
+ * @param destLen pointer to variable set to the size of the decompressed
+ *        data, including the bytes skipped, on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_uncompress_skip(tinf_write_callback write, void *opaque,
+                                unsigned long skip, unsigned long *destLen,
+                                const void *source, unsigned long sourceLen);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source`, passing the
+ * decompressed data to `write`, using a window supplied by the caller.
+ *
+ * Like `tinf_uncompress_write`, but only the last `1 << windowBits` bytes
+ * are kept for matches to refer to, in `window` instead of on the stack,
+ * so data compressed with a small window can be decompressed with little
+ * memory. `windowLen` must be at least `(1 << windowBits) + 1024`, the
+ * rest of `window` is filled with new output before it is passed to
+ * `write`.
+ *
+ * Matches that refer further back than the data kept return
+ * `TINF_DATA_ERROR`.
+ *
+ * @param write function to call with decompressed data
+ * @param opaque value passed to `write`
+ * @param window pointer to buffer for window
+ * @param windowLen size of `window`
+ * @param windowBits base two logarithm of window size, 8 to 15
+ * @param destLen pointer to variable set to the size of the decompressed
+ *        data on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, `TINF_BUF_ERROR` if `windowBits` is out of
+ *         range or `window` is too small, or error code on error
+ */
+long TINFCC tinf_uncompress_window(tinf_write_callback write, void *opaque,
+                                  void *window, unsigned long windowLen,
+                                  unsigned long windowBits,
+                                  unsigned long *destLen,
+                                  const void *source, unsigned long sourceLen);
+
+/**
+ * Function called by `tinf_uncompress_alloc` to allocate or grow its
+ * output buffer, with the semantics of `realloc`.
+ *
+ * @param ptr pointer to buffer to grow, or `NULL` to allocate one
+ * @param size new size of buffer
+ * @param opaque value passed to `tinf_uncompress_alloc`
+ * @return pointer to buffer holding the contents of `ptr`, or `NULL` on
+ *         failure, leaving `ptr` unchanged
+ */
+typedef void *(TINFCC *tinf_grow_callback)(void *ptr, unsigned long size,
+                                          void *opaque);
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to a buffer
+ * that grows as needed.
+ *
+ * Like `tinf_uncompress`, but when the output buffer is full, it is grown
+ * to twice its size with `grow` and decompression continues, so there is
+ * no need to guess the size and start over on `TINF_BUF_ERROR`.
+ *
+ * On entry, `*dest` must be `NULL`, or a buffer of `*destLen` bytes that
+ * can be passed to `grow`. If `*dest` is `NULL`, a buffer of `*destLen`
+ * bytes is allocated first, or 4 KiB if `*destLen` is zero. On return,
+ * `*dest` points to the buffer, also on error, and the caller must free
+ * it. The buffer is not shrunk to fit.
+ *
+ * @param dest pointer to variable containing pointer to buffer
+ * @param destLen pointer to variable containing size of buffer, set to the
+ *        size of the decompressed data on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param grow function to grow buffer, or `NULL` to use `realloc`
+ * @param opaque value passed to `grow`
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_uncompress_alloc(void **dest, unsigned long *destLen,
+                                 const void *source, unsigned long sourceLen,
+                                 tinf_grow_callback grow, void *opaque);
+
+/**
+ * Output buffer for `tinf_uncompress_iov`.
+ *
+ * Has the same members as `struct iovec` from POSIX, and the same layout
+ * on platforms where `size_t` is `unsigned long`.
+ */
+struct tinf_iovec {
+	void *iov_base;         /**< Start of buffer */
+	unsigned long iov_len;  /**< Size of buffer */
+};
+
+/**
+ * Decompress `sourceLen` bytes of deflate data from `source` to the
+ * `iovcnt` buffers in `iov`.
+ *
+ * Like `tinf_uncompress`, but the decompressed data is placed in a list of
+ * buffers, filling each one before moving on to the next, so it can go
+ * directly into fixed size pages. Matches that span buffers are copied one
+ * piece at a time, so this is slower than decompressing to one buffer.
+ *
+ * @param iov array of buffers to place decompressed data in
+ * @param iovcnt number of buffers in `iov`
+ * @param destLen pointer to variable set to the size of the decompressed
+ *        data on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_uncompress_iov(const struct tinf_iovec *iov,
+                               unsigned long iovcnt, unsigned long *destLen,
+                               const void *source, unsigned long sourceLen);
+
 /**
  * Decompress `sourceLen` bytes of gzip data from `source` to `dest`.
  *
@@ -97,6 +481,44 @@ long TINFCC tinf_uncompress(void *dest, unsigned long *destLen,
 long TINFCC tinf_gzip_uncompress(void *dest, unsigned long *destLen,
                                 const void *source, unsigned long sourceLen);
 
+/**
+ * Decompress gzip data from `source` to `dest`, and report how much of
+ * `source` it used.
+ *
+ * Like `tinf_uncompress2`, for gzip data. The trailer is read from after
+ * the deflate data instead of from the end of `source`, and `*sourceLen`
+ * includes it. `*endBit` is the bit offset of the end of the deflate data
+ * from the start of `source`.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen pointer to variable containing size of `source`
+ * @param endBit pointer to variable set to the end of the deflate data in
+ *        bits, or `NULL`
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_gzip_uncompress2(void *dest, unsigned long *destLen,
+                                 const void *source, unsigned long *sourceLen,
+                                 unsigned long *endBit);
+
+/**
+ * Check `sourceLen` bytes of gzip data from `source` without storing the
+ * decompressed data.
+ *
+ * Like `tinf_gzip_uncompress`, but the data is decompressed through a
+ * window on the stack, as in `tinf_uncompress_write`, and its CRC-32 and
+ * length are computed as it goes and compared to the trailer.
+ *
+ * @param destLen pointer to variable set to the size of the decompressed
+ *        data, or `NULL`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` if the data is valid, `TINF_DATA_ERROR` if not
+ */
+long TINFCC tinf_gzip_verify(unsigned long *destLen,
+                            const void *source, unsigned long sourceLen);
+
 /**
  * Decompress `sourceLen` bytes of zlib data from `source` to `dest`.
  *
@@ -115,6 +537,87 @@ long TINFCC tinf_gzip_uncompress(void *dest, unsigned long *destLen,
 long TINFCC tinf_zlib_uncompress(void *dest, unsigned long *destLen,
                                 const void *source, unsigned long sourceLen);
 
+/**
+ * Decompress zlib data from `source` to `dest`, and report how much of
+ * `source` it used.
+ *
+ * Like `tinf_uncompress2`, for zlib data. The Adler-32 checksum is read
+ * from after the deflate data instead of from the end of `source`, and
+ * `*sourceLen` includes it. `*endBit` is the bit offset of the end of the
+ * deflate data from the start of `source`.
+ *
+ * @param dest pointer to where to place decompressed data
+ * @param destLen pointer to variable containing size of `dest`
+ * @param source pointer to compressed data
+ * @param sourceLen pointer to variable containing size of `source`
+ * @param endBit pointer to variable set to the end of the deflate data in
+ *        bits, or `NULL`
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_zlib_uncompress2(void *dest, unsigned long *destLen,
+                                 const void *source, unsigned long *sourceLen,
+                                 unsigned long *endBit);
+
+/**
+ * Check `sourceLen` bytes of zlib data from `source` without storing the
+ * decompressed data.
+ *
+ * Like `tinf_gzip_verify`, for zlib data, comparing the Adler-32 checksum.
+ *
+ * @param destLen pointer to variable set to the size of the decompressed
+ *        data, or `NULL`
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` if the data is valid, `TINF_DATA_ERROR` if not
+ */
+long TINFCC tinf_zlib_verify(unsigned long *destLen,
+                            const void *source, unsigned long sourceLen);
+
+/**
+ * Decompress `sourceLen` bytes of zlib data from `source` to a buffer that
+ * grows as needed.
+ *
+ * Like `tinf_uncompress_alloc`, for zlib data.
+ *
+ * @param dest pointer to variable containing pointer to buffer
+ * @param destLen pointer to variable containing size of buffer, set to the
+ *        size of the decompressed data on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @param grow function to grow buffer, or `NULL` to use `realloc`
+ * @param opaque value passed to `grow`
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_zlib_uncompress_alloc(void **dest, unsigned long *destLen,
+                                      const void *source,
+                                      unsigned long sourceLen,
+                                      tinf_grow_callback grow, void *opaque);
+
+/**
+ * Decompress `sourceLen` bytes of zlib data from `source`, passing the
+ * decompressed data to `write`, using a window supplied by the caller.
+ *
+ * Like `tinf_uncompress_window`, for zlib data, with the window size from
+ * the CINFO field of the zlib header. `windowLen` must be at least that
+ * plus 1024, or this returns `TINF_BUF_ERROR`.
+ *
+ * @param write function to call with decompressed data
+ * @param opaque value passed to `write`
+ * @param window pointer to buffer for window
+ * @param windowLen size of `window`
+ * @param destLen pointer to variable set to the size of the decompressed
+ *        data on success
+ * @param source pointer to compressed data
+ * @param sourceLen size of compressed data
+ * @return `TINF_OK` on success, error code on error
+ */
+long TINFCC tinf_zlib_uncompress_window(tinf_write_callback write,
+                                       void *opaque, void *window,
+                                       unsigned long windowLen,
+                                       unsigned long *destLen,
+                                       const void *source,
+                                       unsigned long sourceLen);
+
 /**
  * Compute Adler-32 checksum of `length` bytes starting at `data`.
  *
@@ -0,0 +1,125 @@
+/*
+ * tinfcpu - CPU feature detection
+ *
+ * Copyright (c) 2026 tinf contributors
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *   1. The origin of this software must not be misrepresented; you must
+ *      not claim that you wrote the original software. If you use this
+ *      software in a product, an acknowledgment in the product
+ *      documentation would be appreciated but is not required.
+ *
+ *   2. Altered source versions must be plainly marked as such, and must
+ *      not be misrepresented as being the original software.
+ *
+ *   3. This notice may not be removed or altered from any source
+ *      distribution.
+ */
+
+#include "tinfint.h"
+
+#if defined(TINF_X86) || defined(TINF_NEON)
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TINF_X86
+#  include <cpuid.h>
+#endif
+
+/* Detected tier, -1 until first use */
+static volatile long tinf_tier = -1;
+
+static long tinf_detect_tier(void)
+{
+#if defined(TINF_X86)
+	unsigned int eax, ebx, ecx, edx;
+	long pclmul;
+
+	__builtin_cpu_init();
+
+	pclmul = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL);
+
+	if (!pclmul || !__builtin_cpu_supports("sse4.2")
+	 || !__builtin_cpu_supports("ssse3")) {
+		return TINF_CPU_SCALAR;
+	}
+
+	if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("bmi2")) {
+		return TINF_CPU_SSE42;
+	}
+
+	if (!__builtin_cpu_supports("avx512f")
+	 || !__builtin_cpu_supports("avx512bw")) {
+		return TINF_CPU_AVX2;
+	}
+
+	return TINF_CPU_AVX512;
+#else
+	/* Advanced SIMD is part of the AArch64 base architecture */
+	return TINF_CPU_NEON;
+#endif
+}
+
+/* Tier named by TINF_CPU, or -1 if unset or unknown */
+static long tinf_env_tier(void)
+{
+	static const char *const names[] = {
+		"scalar", "sse4.2", "avx2", "avx512", "neon"
+	};
+	const char *s = getenv("TINF_CPU");
+	long i;
+
+	if (s == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < (long) (sizeof(names) / sizeof(names[0])); ++i) {
+		if (strcmp(s, names[i]) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+long tinf_cpu_tier(void)
+{
+	long tier = tinf_tier;
+
+	/*
+	 * Threads racing here compute the same value, so there is no need
+	 * for a lock
+	 */
+	if (tier < 0) {
+		long env = tinf_env_tier();
+
+		tier = tinf_detect_tier();
+
+		/* Only allow lower tiers on the same architecture */
+		if (env == TINF_CPU_SCALAR
+		 || (env >= 0 && env <= tier && tier != TINF_CPU_NEON)) {
+			tier = env;
+		}
+
+		tinf_tier = tier;
+	}
+
+	return tier;
+}
+
+#else
+
+long tinf_cpu_tier(void)
+{
+	return TINF_CPU_SCALAR;
+}
+
+#endif
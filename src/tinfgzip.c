@@ -23,7 +23,9 @@
  *      distribution.
  */
 
-#include "tinf.h"
+#include "tinfint.h"
+
+#include <stddef.h>
 
 typedef enum {
 	FTEXT    = 1,
@@ -47,18 +49,14 @@ static unsigned long read_le32(const unsigned char *p)
 	     | ((unsigned long) p[3] << 24);
 }
 
-long tinf_gzip_uncompress(void *dest, unsigned long *destLen,
-                         const void *source, unsigned long sourceLen)
+/* Check gzip header, and set start to the deflate data following it */
+static long tinf_gzip_check_header(const unsigned char *src,
+                                   unsigned long sourceLen,
+                                   const unsigned char **start)
 {
-	const unsigned char *src = (const unsigned char *) source;
-	unsigned char *dst = (unsigned char *) dest;
-	const unsigned char *start;
-	unsigned long dlen, crc32;
-	long res;
+	const unsigned char *p;
 	unsigned char flg;
 
-	/* -- Check header -- */
-
 	/* Check room for at least 10 byte header and 8 byte trailer */
 	if (sourceLen < 18) {
 		return TINF_DATA_ERROR;
@@ -85,52 +83,72 @@ long tinf_gzip_uncompress(void *dest, unsigned long *destLen,
 	/* -- Find start of compressed data -- */
 
 	/* Skip base header of 10 bytes */
-	start = src + 10;
+	p = src + 10;
 
 	/* Skip extra data if present */
 	if (flg & FEXTRA) {
-		unsigned long xlen = read_le16(start);
+		unsigned long xlen = read_le16(p);
 
 		if (xlen > sourceLen - 12) {
 			return TINF_DATA_ERROR;
 		}
 
-		start += xlen + 2;
+		p += xlen + 2;
 	}
 
 	/* Skip file name if present */
 	if (flg & FNAME) {
 		do {
-			if (start - src >= sourceLen) {
+			if (p - src >= sourceLen) {
 				return TINF_DATA_ERROR;
 			}
-		} while (*start++);
+		} while (*p++);
 	}
 
 	/* Skip file comment if present */
 	if (flg & FCOMMENT) {
 		do {
-			if (start - src >= sourceLen) {
+			if (p - src >= sourceLen) {
 				return TINF_DATA_ERROR;
 			}
-		} while (*start++);
+		} while (*p++);
 	}
 
 	/* Check header crc if present */
 	if (flg & FHCRC) {
 		unsigned long hcrc;
 
-		if (start - src > sourceLen - 2) {
+		if (p - src > sourceLen - 2) {
 			return TINF_DATA_ERROR;
 		}
 
-		hcrc = read_le16(start);
+		hcrc = read_le16(p);
 
-		if (hcrc != (tinf_crc32(src, start - src) & 0x0000FFFF)) {
+		if (hcrc != (TINF_CRC32(src, p - src) & 0x0000FFFF)) {
 			return TINF_DATA_ERROR;
 		}
 
-		start += 2;
+		p += 2;
+	}
+
+	*start = p;
+
+	return TINF_OK;
+}
+
+static long tinf_gzip_inflate(void *dest, unsigned long *destLen,
+                              const void *source, unsigned long sourceLen)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	unsigned char *dst = (unsigned char *) dest;
+	const unsigned char *start;
+	unsigned long dlen, crc32;
+	long res;
+
+	/* -- Check header -- */
+
+	if (tinf_gzip_check_header(src, sourceLen, &start) != TINF_OK) {
+		return TINF_DATA_ERROR;
 	}
 
 	/* -- Get decompressed length -- */
@@ -151,8 +169,8 @@ long tinf_gzip_uncompress(void *dest, unsigned long *destLen,
 		return TINF_DATA_ERROR;
 	}
 
-	res = tinf_uncompress(dst, destLen, start,
-	                      (src + sourceLen) - start - 8);
+	res = tinf_inflate(dst, destLen, start,
+	                   (src + sourceLen) - start - 8);
 
 	if (res != TINF_OK) {
 		return TINF_DATA_ERROR;
@@ -164,9 +182,147 @@ long tinf_gzip_uncompress(void *dest, unsigned long *destLen,
 
 	/* -- Check CRC32 checksum -- */
 
-	if (crc32 != tinf_crc32(dst, dlen)) {
+	if (crc32 != TINF_CRC32(dst, dlen)) {
 		return TINF_DATA_ERROR;
 	}
 
 	return TINF_OK;
 }
+
+static long tinf_gzip_inflate2(void *dest, unsigned long *destLen,
+                               const void *source, unsigned long *sourceLen,
+                               unsigned long *endBit)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const unsigned char *start;
+	unsigned long bits = 0;
+	unsigned long used;
+	long res;
+
+	/* -- Check header -- */
+
+	if (tinf_gzip_check_header(src, *sourceLen, &start) != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Decompress data -- */
+
+	res = tinf_inflate_bits(dest, destLen, start,
+	                        (src + *sourceLen) - start, &bits);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Check trailer, which follows the deflate data -- */
+
+	used = (start - src) + (bits + 7) / 8;
+
+	if (*sourceLen - used < 8) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (read_le32(&src[used + 4]) != (*destLen & 0xFFFFFFFFUL)) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (read_le32(&src[used]) != TINF_CRC32(dest, *destLen)) {
+		return TINF_DATA_ERROR;
+	}
+
+	*sourceLen = used + 8;
+
+	if (endBit != NULL) {
+		*endBit = 8 * (start - src) + bits;
+	}
+
+	return TINF_OK;
+}
+
+/* Write callback that only updates the CRC-32 checksum in opaque */
+static long TINFCC tinf_gzip_check_write(const void *buf, unsigned long size,
+                                         void *opaque)
+{
+	unsigned long *crc = (unsigned long *) opaque;
+
+	*crc = TINF_CRC32_UPDATE(*crc, buf, size);
+
+	return 0;
+}
+
+static long tinf_gzip_inflate_verify(unsigned long *destLen,
+                                     const void *source,
+                                     unsigned long sourceLen)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	const unsigned char *start;
+	unsigned long crc = 0;
+	long res;
+
+	/* -- Check header -- */
+
+	if (tinf_gzip_check_header(src, sourceLen, &start) != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Decompress data, computing the checksum as it is written -- */
+
+	if ((src + sourceLen) - start < 8) {
+		return TINF_DATA_ERROR;
+	}
+
+	res = tinf_inflate_write(tinf_gzip_check_write, &crc, 0, destLen,
+	                         start, (src + sourceLen) - start - 8);
+
+	if (res != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Check length and CRC32 checksum -- */
+
+	if (read_le32(&src[sourceLen - 4]) != (*destLen & 0xFFFFFFFFUL)) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (read_le32(&src[sourceLen - 8]) != crc) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+long tinf_gzip_uncompress(void *dest, unsigned long *destLen,
+                         const void *source, unsigned long sourceLen)
+{
+	long res = tinf_gzip_inflate(dest, destLen, source, sourceLen);
+
+	TINF_COUNT_CALL(TINF_API_GZIP, sourceLen, *destLen, res);
+
+	return res;
+}
+
+long tinf_gzip_uncompress2(void *dest, unsigned long *destLen,
+                           const void *source, unsigned long *sourceLen,
+                           unsigned long *endBit)
+{
+	long res = tinf_gzip_inflate2(dest, destLen, source, sourceLen, endBit);
+
+	TINF_COUNT_CALL(TINF_API_GZIP2, *sourceLen, *destLen, res);
+
+	return res;
+}
+
+long tinf_gzip_verify(unsigned long *destLen,
+                      const void *source, unsigned long sourceLen)
+{
+	unsigned long dlen = 0;
+	long res = tinf_gzip_inflate_verify(&dlen, source, sourceLen);
+
+	if (destLen != NULL) {
+		*destLen = dlen;
+	}
+
+	TINF_COUNT_CALL(TINF_API_GZIP_VERIFY, sourceLen, dlen, res);
+
+	return res;
+}
@@ -0,0 +1,170 @@
+/*
+ * tinfint - tinf internal definitions
+ *
+ * Copyright (c) 2026 tinf contributors
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *   1. The origin of this software must not be misrepresented; you must
+ *      not claim that you wrote the original software. If you use this
+ *      software in a product, an acknowledgment in the product
+ *      documentation would be appreciated but is not required.
+ *
+ *   2. Altered source versions must be plainly marked as such, and must
+ *      not be misrepresented as being the original software.
+ *
+ *   3. This notice may not be removed or altered from any source
+ *      distribution.
+ */
+
+#ifndef TINFINT_H_INCLUDED
+#define TINFINT_H_INCLUDED
+
+#include "tinf.h"
+
+/* Inflate raw deflate data, without counting it as a call to the API */
+long tinf_inflate(void *dest, unsigned long *destLen,
+                  const void *source, unsigned long sourceLen);
+
+/* Like tinf_inflate, also setting endBit to the number of bits used */
+long tinf_inflate_bits(void *dest, unsigned long *destLen,
+                       const void *source, unsigned long sourceLen,
+                       unsigned long *endBit);
+
+/* Like tinf_inflate, but growing dest with grow (realloc if NULL) */
+long tinf_inflate_alloc(void **dest, unsigned long *destLen,
+                        const void *source, unsigned long sourceLen,
+                        tinf_grow_callback grow, void *opaque);
+
+/* Like tinf_uncompress_skip, without counting it as a call to the API */
+long tinf_inflate_write(tinf_write_callback write, void *opaque,
+                        unsigned long skip, unsigned long *destLen,
+                        const void *source, unsigned long sourceLen);
+
+/* Like tinf_uncompress_window, without counting it as a call to the API */
+long tinf_inflate_window(tinf_write_callback write, void *opaque,
+                         void *window, unsigned long windowLen,
+                         unsigned long windowBits, unsigned long *destLen,
+                         const void *source, unsigned long sourceLen);
+
+/* Update checksums with more data, starting from 0 for CRC-32, 1 for Adler-32 */
+unsigned long tinf_crc32_update(unsigned long crc, const void *data,
+                                unsigned long length);
+unsigned long tinf_adler32_update(unsigned long a32, const void *data,
+                                  unsigned long length);
+
+#if defined(TINF_BLOCK_STATS) || defined(TINF_COUNTERS)
+/* Monotonic time in nanoseconds, wraps around with unsigned long */
+unsigned long tinf_clock_ns(void);
+#endif
+
+/*
+ * Engine profiles. TINF_SMALL keeps the compact bit by bit decoder with no
+ * tree cache or CPU specific code, TINF_FAST selects table driven decoding
+ * with a 64-bit bit buffer. Without either, the individual options apply.
+ */
+#if defined(TINF_SMALL) && defined(TINF_FAST)
+#  error "only one of TINF_SMALL and TINF_FAST can be defined"
+#endif
+
+#ifdef TINF_SMALL
+#  undef TINF_TABLES
+#  ifndef TINF_NO_SIMD
+#    define TINF_NO_SIMD 1
+#  endif
+#  ifndef TINF_TREE_CACHE
+#    define TINF_TREE_CACHE 0
+#  endif
+#endif
+
+#if defined(TINF_FAST) && !defined(TINF_TABLES)
+#  define TINF_TABLES 1
+#endif
+
+/*
+ * CPU specific code is compiled with GCC or Clang target attributes and
+ * selected at run time, define TINF_NO_SIMD to use portable code only
+ */
+#if !defined(TINF_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) \
+ && ((defined(__GNUC__) && __GNUC__ >= 5) || defined(__clang__))
+#  define TINF_X86 1
+#endif
+
+#if !defined(TINF_NO_SIMD) && defined(__aarch64__) \
+ && !defined(__ARM_BIG_ENDIAN) && (defined(__GNUC__) || defined(__clang__))
+#  define TINF_NEON 1
+#endif
+
+/* CPU tiers, in increasing order for x86 */
+enum tinf_cpu_tier {
+	TINF_CPU_SCALAR,
+	TINF_CPU_SSE42, /* SSE4.2, SSSE3, PCLMULQDQ */
+	TINF_CPU_AVX2, /* AVX2, BMI2 */
+	TINF_CPU_AVX512, /* AVX-512F, AVX-512BW */
+	TINF_CPU_NEON
+};
+
+/*
+ * Get the best tier supported by the CPU, or the tier named by the
+ * environment variable TINF_CPU if that is lower. Detected on first use.
+ */
+long tinf_cpu_tier(void);
+
+/*
+ * USDT probes, provider tinf. A probe is a single nop until a tracer
+ * attaches to it, for instance:
+ *
+ *   bpftrace -e 'usdt:./libtinf.so:tinf:block_end { @[arg0] = count(); }'
+ */
+#ifdef TINF_USDT
+#  include <sys/sdt.h>
+#  define TINF_PROBE1(name, a) DTRACE_PROBE1(tinf, name, a)
+#  define TINF_PROBE2(name, a, b) DTRACE_PROBE2(tinf, name, a, b)
+#  define TINF_PROBE3(name, a, b, c) DTRACE_PROBE3(tinf, name, a, b, c)
+#  define TINF_PROBE4(name, a, b, c, d) DTRACE_PROBE4(tinf, name, a, b, c, d)
+#else
+#  define TINF_PROBE1(name, a) do { } while (0)
+#  define TINF_PROBE2(name, a, b) do { } while (0)
+#  define TINF_PROBE3(name, a, b, c) do { } while (0)
+#  define TINF_PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+#ifdef TINF_COUNTERS
+void tinf_count_call(long api, unsigned long in, unsigned long out, long res);
+void tinf_count_block(long btype);
+
+#  define TINF_COUNT_CALL(api, in, out, res) tinf_count_call(api, in, out, res)
+#  define TINF_COUNT_BLOCK(btype) tinf_count_block(btype)
+#else
+#  define TINF_COUNT_CALL(api, in, out, res) do { } while (0)
+#  define TINF_COUNT_BLOCK(btype) do { } while (0)
+#endif
+
+/* Checksums computed by the zlib and gzip wrappers may be counted or traced */
+#if defined(TINF_COUNTERS) || defined(TINF_USDT)
+unsigned long tinf_traced_crc32(unsigned long crc, const void *data,
+                                unsigned long length);
+unsigned long tinf_traced_adler32(unsigned long a32, const void *data,
+                                  unsigned long length);
+
+#  define TINF_CRC32_UPDATE(crc, data, length) \
+	tinf_traced_crc32(crc, data, length)
+#  define TINF_ADLER32_UPDATE(a32, data, length) \
+	tinf_traced_adler32(a32, data, length)
+#else
+#  define TINF_CRC32_UPDATE(crc, data, length) \
+	tinf_crc32_update(crc, data, length)
+#  define TINF_ADLER32_UPDATE(a32, data, length) \
+	tinf_adler32_update(a32, data, length)
+#endif
+
+#define TINF_CRC32(data, length) TINF_CRC32_UPDATE(0, data, length)
+#define TINF_ADLER32(data, length) TINF_ADLER32_UPDATE(1, data, length)
+
+#endif /* TINFINT_H_INCLUDED */
@@ -23,38 +23,337 @@
  *      distribution.
  */
 
-#include "tinf.h"
+/* memfd_create is a GNU extension */
+#if defined(TINF_RING) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE 1
+#endif
+
+#include "tinfint.h"
 
 #include <assert.h>
 #include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TINF_RING
+#  include <pthread.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+#if defined(TINF_TABLES) && defined(TINF_X86)
+#  include <immintrin.h>
+#endif
+
+#if defined(TINF_TABLES) && defined(TINF_NEON)
+#  include <arm_neon.h>
+#endif
 
 #if defined(ULONG_MAX) && (ULONG_MAX) < 0xFFFFFFFFUL
 #  error "tinf requires unsigned long to be at least 32-bit"
 #endif
 
+/*
+ * Number of dynamic trees kept per stream, so consecutive blocks that send
+ * the same code lengths reuse the trees instead of building them again.
+ * Each entry takes about 1.6 KiB in tinf_data (7.3 KiB with TINF_TABLES),
+ * set to 0 to disable.
+ */
+#ifndef TINF_TREE_CACHE
+#  ifdef TINF_TABLES
+#    define TINF_TREE_CACHE 2
+#  else
+#    define TINF_TREE_CACHE 4
+#  endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define TINF_ALWAYS_INLINE __inline__ __attribute__((always_inline))
+#  define TINF_NOINLINE __attribute__((noinline))
+#else
+#  define TINF_ALWAYS_INLINE
+#  define TINF_NOINLINE
+#endif
+
+/* Size of the input buffer of tinf_uncompress_read, on its stack */
+#ifndef TINF_READ_BUF_SIZE
+#  define TINF_READ_BUF_SIZE 4096
+#endif
+
+/*
+ * Size of the output window of tinf_uncompress_write, on its stack. The
+ * last 32 KiB are kept when it is flushed, so it must be larger than that.
+ * The small profile uses the minimum, which also fits a 16-bit size_t.
+ */
+#ifndef TINF_WRITE_BUF_SIZE
+#  ifdef TINF_SMALL
+#    define TINF_WRITE_BUF_SIZE (32768L + 1024)
+#  else
+#    define TINF_WRITE_BUF_SIZE 65536
+#  endif
+#endif
+
+#if TINF_WRITE_BUF_SIZE < 32768L + 1024
+#  error "TINF_WRITE_BUF_SIZE must be at least 32768 + 1024"
+#endif
+
+/*
+ * Size of the ring window of tinf_uncompress_write with TINF_RING, rounded
+ * up to a multiple of the page size. Output is passed to the callback in
+ * pieces of up to this size.
+ */
+#ifndef TINF_RING_SIZE
+#  define TINF_RING_SIZE 262144
+#endif
+
+#if TINF_RING_SIZE < 65536L
+#  error "TINF_RING_SIZE must be at least 65536"
+#endif
+
+/* Smallest output buffer allocated by tinf_uncompress_alloc */
+#ifndef TINF_GROW_MIN
+#  define TINF_GROW_MIN 4096
+#endif
+
+#if TINF_GROW_MIN < 1024
+#  error "TINF_GROW_MIN must be at least 1024"
+#endif
+
+#ifdef TINF_TABLES
+/*
+ * Returned by the decode loop when the output is full, see pending_length.
+ * Not one of the status codes in tinf.h.
+ */
+#  define TINF_FULL 2
+#endif
+
+/*
+ * Bit reader functions used by the decode loop. With table driven decoding
+ * they are always inlined, so each variant of the loop gets its own copy.
+ */
+#ifdef TINF_TABLES
+#  define TINF_HOT TINF_ALWAYS_INLINE
+#else
+#  define TINF_HOT
+#endif
+
+/*
+ * Define TINF_PREFETCH_DIST to prefetch the source of matches with larger
+ * distances as soon as the distance is known. This is off by default, as
+ * it made no difference on CPUs where the 32 KiB window fits in L1 cache.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#  define TINF_PREFETCH(p) __builtin_prefetch(p)
+#else
+#  define TINF_PREFETCH(p) ((void) 0)
+#endif
+
+#ifdef TINF_BLOCK_STATS
+#  ifndef TINF_STATS_CLOCK
+#    define TINF_STATS_CLOCK() tinf_clock_ns()
+#  endif
+#  define TINF_STAT(stmt) do { stmt; } while (0)
+#else
+#  define TINF_STAT(stmt) do { } while (0)
+#endif
+
 /* -- Internal data structures -- */
 
+/*
+ * Bit buffer. The fast profile reads a whole 64-bit word at a time while
+ * there are at least 8 bytes of source left.
+ */
+#ifdef TINF_FAST
+typedef unsigned long long tinf_bits;
+#  define TINF_TAG_BITS 64
+#else
+typedef unsigned long tinf_bits;
+#  define TINF_TAG_BITS 32
+#endif
+
 struct tinf_tree {
 	unsigned short counts[16]; /* Number of codes with a given length */
 	unsigned short symbols[288]; /* Symbols sorted by code */
 	long max_sym;
 };
 
+/* Code length code table entry, see tinf_build_clen_table */
+struct tinf_clen_entry {
+	unsigned char sym; /* Code length symbol (0-18) */
+	unsigned char bits; /* Code length plus number of extra bits */
+	unsigned char extra; /* Number of extra bits */
+	unsigned char base; /* Repeat count without extra bits */
+};
+
+#ifdef TINF_TABLES
+/*
+ * Decode table entry.
+ *
+ * The first 2^root entries of a table are indexed by the next root bits of
+ * input. Codes longer than root bits continue in a subtable, indexed by
+ * the following bits. The kind of entry is given by the upper bits of op:
+ *
+ *   TINF_OP_LIT   literal value
+ *   TINF_OP_LIT2  two literals, value & 0xFF first, op & 0x0F is the code
+ *                 length of the first
+ *   TINF_OP_LEN   length base value, op & 0x0F extra bits
+ *   TINF_OP_DIST  distance base value, op & 0x0F extra bits
+ *   TINF_OP_EOB   end of block
+ *   TINF_OP_SUB   subtable at offset value with op & 0x0F index bits
+ *   TINF_OP_BAD   invalid symbol
+ *
+ * bits is the number of bits to remove from input, for a subtable entry
+ * this is root, and for entries in a subtable it does not include root.
+ *
+ * If the extra bits of a length or distance code fit in the root bits
+ * along with the code, they are included in the index, value, and bits
+ * of the entry, and op & 0x0F is zero.
+ */
+struct tinf_entry {
+	unsigned short value;
+	unsigned char bits;
+	unsigned char op;
+};
+
+#define TINF_OP_LIT  0x00
+#define TINF_OP_LIT2 0x10
+#define TINF_OP_LEN  0x20
+#define TINF_OP_DIST 0x30
+#define TINF_OP_EOB  0x40
+#define TINF_OP_SUB  0x50
+#define TINF_OP_BAD  0x60
+
+#define TINF_LTABLE_BITS 10
+#define TINF_DTABLE_BITS 8
+
+/* Maximum table sizes, computed with enough from zlib/examples */
+#define TINF_LTABLE_SIZE 1334 /* enough 288 10 15 */
+#define TINF_DTABLE_SIZE 402 /* enough 32 8 15 */
+
+/* Codes used to decode a block */
+struct tinf_codes {
+	struct tinf_entry ltable[TINF_LTABLE_SIZE]; /* Literal/length table */
+	struct tinf_entry dtable[TINF_DTABLE_SIZE]; /* Distance table */
+	long single; /* Non-zero if no code needs a sub-table */
+};
+#else
+/* Codes used to decode a block */
+struct tinf_codes {
+	struct tinf_tree ltree; /* Literal/length tree */
+	struct tinf_tree dtree; /* Distance tree */
+};
+#endif
+
+struct tinf_tree_cache_entry {
+	unsigned long hash; /* Hash of the code length runs */
+	unsigned long hlit;
+	unsigned long hdist; /* Zero if entry is unused */
+	unsigned char lengths[288 + 32];
+	struct tinf_codes codes;
+};
+
 struct tinf_data {
 	const unsigned char *source;
 	const unsigned char *source_end;
-	unsigned long tag;
+	tinf_bits tag;
 	long bitcount;
-	long overflow;
+	long overflow; /* Number of zero bits added past the end of source */
 
 	unsigned char *dest_start;
 	unsigned char *dest;
 	unsigned char *dest_end;
 
-	struct tinf_tree ltree; /* Literal/length tree */
-	struct tinf_tree dtree; /* Distance tree */
+	struct tinf_codes codes; /* Fixed or uncached dynamic codes */
+
+#ifdef TINF_TABLES
+	struct tinf_tree ltree; /* Trees the tables are built from */
+	struct tinf_tree dtree;
+	long codes_fixed; /* Non-zero if codes holds the fixed tables */
+#endif
+
+#if TINF_TREE_CACHE > 0
+	struct tinf_tree_cache_entry cache[TINF_TREE_CACHE];
+	long cache_next; /* Entry to replace next */
+#endif
+
+	const unsigned char *source_start;
+	unsigned long source_base; /* Number of bytes before source_start */
+
+	/* Input callback, NULL if all input is in source or at end of input */
+	tinf_read_callback read;
+	void *read_opaque;
+	unsigned char *in_buf;
+
+	unsigned long dest_base; /* Number of bytes before dest_start */
+
+	/* Output callback, NULL if output goes directly to dest */
+	tinf_write_callback write;
+	void *write_opaque;
+	unsigned char *dest_flushed; /* Start of bytes not yet written */
+	unsigned long skip; /* Number of bytes of output not passed to write */
+	unsigned long window; /* Number of bytes kept for matches when flushed */
+
+	/* Output allocator, NULL if dest has a fixed size */
+	tinf_grow_callback grow;
+	void *grow_opaque;
+
+	long prefix; /* Non-zero to stop with TINF_OUTPUT_FULL when dest fills */
+
+#ifdef TINF_RING
+	/* Size of the window at dest_start if it is mapped twice, else 0 */
+	unsigned long ring_size;
+#endif
+
+	/* Output buffers, NULL if output goes to dest only */
+	const struct tinf_iovec *iov;
+	unsigned long iov_count;
+	unsigned long iov_index; /* Index of the buffer dest is in */
+
+#ifdef TINF_TABLES
+	/* Symbol the decode loop had no room for, offs is 0 for a literal */
+	long pending_length;
+	long pending_offs;
+#endif
+
+#ifdef TINF_BLOCK_STATS
+	unsigned long block_clock;
+	struct tinf_block_stats stats;
+#endif
+};
+
+/* -- Internal data -- */
+
+/* Extra bits and base tables for length codes */
+static const unsigned char length_bits[30] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+	1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+	4, 4, 4, 4, 5, 5, 5, 5, 0, 127
+};
+
+static const unsigned short length_base[30] = {
+	 3,  4,  5,   6,   7,   8,   9,  10,  11,  13,
+	15, 17, 19,  23,  27,  31,  35,  43,  51,  59,
+	67, 83, 99, 115, 131, 163, 195, 227, 258,   0
+};
+
+/* Extra bits and base tables for distance codes */
+static const unsigned char dist_bits[30] = {
+	0, 0,  0,  0,  1,  1,  2,  2,  3,  3,
+	4, 4,  5,  5,  6,  6,  7,  7,  8,  8,
+	9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const unsigned short dist_base[30] = {
+	   1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
+	  33,   49,   65,   97,  129,  193,  257,   385,   513,   769,
+	1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
 };
 
+#ifdef TINF_BLOCK_STATS
+static tinf_block_callback tinf_block_cb = 0;
+static void *tinf_block_cb_opaque = 0;
+#endif
+
 /* -- Utility functions -- */
 
 static unsigned long read_le16(const unsigned char *p)
@@ -173,464 +472,2188 @@ static long tinf_build_tree(struct tinf_tree *t, const unsigned char *lengths,
 	return TINF_OK;
 }
 
-/* -- Decode functions -- */
-
-static void tinf_refill(struct tinf_data *d, long num)
+/*
+ * Given the code length tree, build a table indexed by the next 7 bits of
+ * input, with the symbol, the number of bits it takes including any repeat
+ * count extra bits, and the repeat count base.
+ *
+ * Code length codes are at most 7 bits, and the tree is complete (or has
+ * a single code of length 1, padded with an invalid symbol), so every
+ * entry is filled.
+ */
+static void tinf_build_clen_table(const struct tinf_tree *t,
+                                  struct tinf_clen_entry *table)
 {
-	assert(num >= 0 && num <= 32);
+	/* Extra bits and repeat count base for symbols 16, 17, and 18 */
+	static const unsigned char repeat_bits[3] = { 2, 3, 7 };
+	static const unsigned char repeat_base[3] = { 3, 3, 11 };
 
-	/* Read bytes until at least num bits available */
-	while (d->bitcount < num) {
-		if (d->source != d->source_end) {
-			d->tag |= (unsigned long) *d->source++ << d->bitcount;
-		}
-		else {
-			d->overflow = 1;
-		}
-		d->bitcount += 8;
-	}
+	unsigned long code = 0, idx = 0;
+	long len;
 
-	assert(d->bitcount <= 32);
-}
+	for (len = 1; len <= 7; ++len) {
+		unsigned long n;
 
-static unsigned long tinf_getbits_no_refill(struct tinf_data *d, long num)
-{
-	unsigned long bits;
+		for (n = 0; n < t->counts[len]; ++n, ++idx, ++code) {
+			unsigned long rev = 0, i;
+			long bit;
+			struct tinf_clen_entry e;
 
-	assert(num >= 0 && num <= d->bitcount);
+			e.sym = t->symbols[idx];
 
-	/* Get bits from tag */
-	bits = d->tag & ((1UL << num) - 1);
+			if (e.sym >= 16 && e.sym <= 18) {
+				e.extra = repeat_bits[e.sym - 16];
+				e.base = repeat_base[e.sym - 16];
+			}
+			else {
+				e.extra = 0;
+				e.base = 1;
+			}
+			e.bits = len + e.extra;
 
-	/* Remove bits from tag */
-	d->tag >>= num;
-	d->bitcount -= num;
+			/* Codes are stored most significant bit first */
+			for (bit = 0; bit < len; ++bit) {
+				rev |= ((code >> bit) & 1) << (len - 1 - bit);
+			}
 
-	return bits;
+			for (i = rev; i < 128; i += 1UL << len) {
+				table[i] = e;
+			}
+		}
+
+		code <<= 1;
+	}
 }
 
-/* Get num bits from source stream */
-static unsigned long tinf_getbits(struct tinf_data *d, long num)
+#ifdef TINF_TABLES
+/* Reverse the lowest num bits of code */
+static unsigned long tinf_reverse(unsigned long code, long num)
 {
-	tinf_refill(d, num);
-	return tinf_getbits_no_refill(d, num);
+	unsigned long rev = 0;
+	long i;
+
+	for (i = 0; i < num; ++i) {
+		rev = (rev << 1) | ((code >> i) & 1);
+	}
+
+	return rev;
 }
 
-/* Read a num bit value from stream and add base */
-static unsigned long tinf_getbits_base(struct tinf_data *d, long num, long base)
+/* Table entry for symbol sym of a literal/length or distance tree */
+static struct tinf_entry tinf_symbol_entry(const struct tinf_tree *t,
+                                           long sym, long dist)
 {
-	return base + (num ? tinf_getbits(d, num) : 0);
+	struct tinf_entry e;
+
+	e.value = 0;
+	e.bits = 0;
+
+	if (sym > t->max_sym) {
+		e.op = TINF_OP_BAD;
+	}
+	else if (dist) {
+		if (sym <= 29) {
+			e.op = TINF_OP_DIST | dist_bits[sym];
+			e.value = dist_base[sym];
+		}
+		else {
+			e.op = TINF_OP_BAD;
+		}
+	}
+	else if (sym < 256) {
+		e.op = TINF_OP_LIT;
+		e.value = sym;
+	}
+	else if (sym == 256) {
+		e.op = TINF_OP_EOB;
+	}
+	else if (sym <= 285) {
+		e.op = TINF_OP_LEN | length_bits[sym - 257];
+		e.value = length_base[sym - 257];
+	}
+	else {
+		e.op = TINF_OP_BAD;
+	}
+
+	return e;
 }
 
-/* Given a data stream and a tree, decode a symbol */
-static long tinf_decode_symbol(struct tinf_data *d, const struct tinf_tree *t)
+/*
+ * Given a tree, build a decode table with 2^root entries and subtables for
+ * longer codes. The table must hold TINF_LTABLE_SIZE or TINF_DTABLE_SIZE
+ * entries.
+ */
+static void tinf_build_table(struct tinf_entry *table,
+                             const struct tinf_tree *t, long root, long dist)
 {
-	long base = 0, offs = 0;
+	unsigned long code = 0, idx = 0, next = 1UL << root;
+	unsigned long prefix = (unsigned long) -1, sub = 0;
+	long sub_bits = 0;
 	long len;
 
-	/*
-	 * Get more bits while code index is above number of codes
-	 *
-	 * Rather than the actual code, we are computing the position of the
-	 * code in the sorted order of codes, which is the index of the
-	 * corresponding symbol.
-	 *
-	 * Conceptually, for each code length (level in the tree), there are
-	 * counts[len] leaves on the left and longernal nodes on the right.
-	 * The index we have decoded so far is base + offs, and if that
-	 * falls within the leaves we are done. Otherwise we adjust the range
-	 * of offs and add one more bit to it.
-	 */
-	for (len = 1; ; ++len) {
-		offs = 2 * offs + tinf_getbits(d, 1);
-
-		assert(len <= 15);
+	/* Empty tree, any symbol is invalid */
+	if (t->max_sym == -1) {
+		unsigned long i;
 
-		if (offs < t->counts[len]) {
-			break;
+		for (i = 0; i < next; ++i) {
+			table[i] = tinf_symbol_entry(t, 0, dist);
 		}
 
-		base += t->counts[len];
-		offs -= t->counts[len];
+		return;
 	}
 
-	assert(base + offs >= 0 && base + offs < 288);
+	for (len = 1; len <= 15; ++len) {
+		unsigned long n;
 
-	return t->symbols[base + offs];
-}
+		for (n = 0; n < t->counts[len]; ++n, ++idx, ++code) {
+			struct tinf_entry e = tinf_symbol_entry(t, t->symbols[idx], dist);
+			unsigned long i;
 
-/* Given a data stream, decode dynamic trees from it */
-static long tinf_decode_trees(struct tinf_data *d, struct tinf_tree *lt,
-                             struct tinf_tree *dt)
-{
-	unsigned char lengths[288 + 32];
+			if (len <= root) {
+				long extra = e.op & 0x0F;
 
-	/* Special ordering of code length codes */
-	static const unsigned char clcidx[19] = {
-		16, 17, 18, 0,  8, 7,  9, 6, 10, 5,
-		11,  4, 12, 3, 13, 2, 14, 1, 15
-	};
+				e.bits = len;
 
-	unsigned long hlit, hdist, hclen;
-	unsigned long i, num, length;
-	long res;
+				/* Include extra bits in the entry if they fit */
+				if ((e.op == (TINF_OP_LEN | extra)
+				  || e.op == (TINF_OP_DIST | extra))
+				 && len + extra <= root) {
+					e.bits = len + extra;
+					e.op -= extra;
+				}
 
-	/* Get 5 bits HLIT (257-286) */
-	hlit = tinf_getbits_base(d, 5, 257);
+				for (i = tinf_reverse(code, len); i < 1UL << root;
+				     i += 1UL << len) {
+					table[i] = e;
 
-	/* Get 5 bits HDIST (1-32) */
-	hdist = tinf_getbits_base(d, 5, 1);
+					if (e.bits > len) {
+						table[i].value += (i >> len) & ((1UL << extra) - 1);
+					}
+				}
 
-	/* Get 4 bits HCLEN (4-19) */
-	hclen = tinf_getbits_base(d, 4, 4);
+				continue;
+			}
 
-	/*
-	 * The RFC limits the range of HLIT to 286, but lists HDIST as range
-	 * 1-32, even though distance codes 30 and 31 have no meaning. While
-	 * we could allow the full range of HLIT and HDIST to make it possible
-	 * to decode the fixed trees with this function, we consider it an
-	 * error here.
-	 *
-	 * See also: https://github.com/madler/zlib/issues/82
-	 */
-	if (hlit > 286 || hdist > 30) {
-		return TINF_DATA_ERROR;
-	}
+			/* Start a new subtable when the first root bits change */
+			if (tinf_reverse(code >> (len - root), root) != prefix) {
+				long left;
 
-	for (i = 0; i < 19; ++i) {
-		lengths[i] = 0;
-	}
+				prefix = tinf_reverse(code >> (len - root), root);
 
-	/* Read code lengths for code length alphabet */
-	for (i = 0; i < hclen; ++i) {
-		/* Get 3 bits code length (0-7) */
-		unsigned long clen = tinf_getbits(d, 3);
+				/*
+				 * Size the subtable to hold the remaining codes
+				 * with this prefix
+				 */
+				sub_bits = len - root;
+				left = (1L << sub_bits) - (t->counts[len] - n);
 
-		lengths[clcidx[i]] = clen;
-	}
+				while (left > 0 && root + sub_bits < 15) {
+					++sub_bits;
+					left = 2 * left - t->counts[root + sub_bits];
+				}
 
-	/* Build code length tree (in literal/length tree to save space) */
-	res = tinf_build_tree(lt, lengths, 19);
+				sub = next;
+				next += 1UL << sub_bits;
 
-	if (res != TINF_OK) {
-		return res;
+				assert(next <= (dist ? TINF_DTABLE_SIZE : TINF_LTABLE_SIZE));
+
+				table[prefix].value = sub;
+				table[prefix].bits = root;
+				table[prefix].op = TINF_OP_SUB | sub_bits;
+			}
+
+			e.bits = len - root;
+
+			for (i = tinf_reverse(code, len - root); i < 1UL << sub_bits;
+			     i += 1UL << (len - root)) {
+				table[sub + i] = e;
+			}
+		}
+
+		code <<= 1;
 	}
+}
 
-	/* Check code length tree is not empty */
-	if (lt->max_sym == -1) {
-		return TINF_DATA_ERROR;
+/*
+ * Combine pairs of literals whose codes both fit in the first 2^root
+ * entries of a literal/length table into one entry
+ */
+static void tinf_pair_literals(struct tinf_entry *table, long root)
+{
+	unsigned long i = 1UL << root;
+
+	/*
+	 * The second literal is looked up at index i >> bits, which is below
+	 * i, so going down reads entries that have not been combined yet
+	 */
+	while (i-- > 0) {
+		struct tinf_entry e = table[i];
+		struct tinf_entry e2 = table[i >> e.bits];
+
+		if (e.op == TINF_OP_LIT && e2.op == TINF_OP_LIT
+		 && e.bits + e2.bits <= root) {
+			table[i].value = e.value | (e2.value << 8);
+			table[i].bits = e.bits + e2.bits;
+			table[i].op = TINF_OP_LIT2 | e.bits;
+		}
 	}
+}
 
-	/* Decode code lengths for the dynamic trees */
-	for (num = 0; num < hlit + hdist; ) {
-		long sym = tinf_decode_symbol(d, lt);
+/* Check if all codes in tree t are at most root bits long */
+static long tinf_fits_root(const struct tinf_tree *t, long root)
+{
+	long len;
 
-		if (sym > lt->max_sym) {
-			return TINF_DATA_ERROR;
+	for (len = root + 1; len < 16; ++len) {
+		if (t->counts[len] != 0) {
+			return 0;
 		}
+	}
 
-		switch (sym) {
-		case 16:
-			/* Copy previous code length 3-6 times (read 2 bits) */
+	return 1;
+}
+
+/* Build decode tables from trees */
+static void tinf_build_codes(struct tinf_codes *c, const struct tinf_tree *lt,
+                             const struct tinf_tree *dt)
+{
+	tinf_build_table(c->ltable, lt, TINF_LTABLE_BITS, 0);
+	tinf_pair_literals(c->ltable, TINF_LTABLE_BITS);
+	tinf_build_table(c->dtable, dt, TINF_DTABLE_BITS, 1);
+
+	c->single = tinf_fits_root(lt, TINF_LTABLE_BITS)
+	         && tinf_fits_root(dt, TINF_DTABLE_BITS);
+}
+#endif
+
+/* -- Input -- */
+
+/*
+ * Read more input with the read callback, if any, and return the number of
+ * bytes added. The 8 bytes before source are kept, because the stored block
+ * code moves source back by the whole bytes left in tag.
+ */
+static TINF_NOINLINE unsigned long tinf_fill_input(struct tinf_data *d)
+{
+	unsigned long keep, left;
+	long n;
+
+	if (d->read == NULL) {
+		return 0;
+	}
+
+	keep = d->source - d->source_start;
+	if (keep > 8) {
+		keep = 8;
+	}
+	left = d->source_end - d->source;
+
+	/* Move kept and unread bytes to the start of the buffer */
+	d->source_base += (d->source - keep) - d->source_start;
+	memmove(d->in_buf, d->source - keep, keep + left);
+	d->source_start = d->in_buf;
+	d->source = d->in_buf + keep;
+	d->source_end = d->source + left;
+
+	n = d->read(d->in_buf + keep + left, TINF_READ_BUF_SIZE - keep - left,
+	            d->read_opaque);
+
+	if (n <= 0) {
+		/* End of input, do not call read again */
+		d->read = NULL;
+		return 0;
+	}
+
+	d->source_end += n;
+
+	return (unsigned long) n;
+}
+
+/* -- Output -- */
+
+/* Number of bytes written from the start of the output */
+static unsigned long tinf_dest_pos(const struct tinf_data *d)
+{
+	return d->dest_base + (unsigned long) (d->dest - d->dest_start);
+}
+
+/*
+ * Pass the output in the window to the write callback, and move the last
+ * 32 KiB (or window bytes) to the start of the window for matches to refer
+ * to. Returns non-zero on success.
+ */
+static long tinf_flush_output(struct tinf_data *d)
+{
+	unsigned char *from = d->dest_flushed;
+	unsigned long pos = d->dest_base + (from - d->dest_start);
+	unsigned long keep;
+
+	/* Leave out output before skip */
+	if (pos < d->skip) {
+		from = d->skip - pos < (unsigned long) (d->dest - from)
+		     ? from + (d->skip - pos) : d->dest;
+	}
+
+	if (d->dest != from
+	 && d->write(from, d->dest - from, d->write_opaque) != 0) {
+		d->write = NULL;
+		return 0;
+	}
+
+#ifdef TINF_RING
+	if (d->ring_size != 0) {
+		/*
+		 * Once the last 32 KiB are all in the second mapping, step back
+		 * a lap to the same bytes in the first. Output may fill up to
+		 * one lap past what was flushed, and never beyond the mapping.
+		 */
+		if (d->dest - d->dest_start >= d->ring_size + d->window) {
+			d->dest -= d->ring_size;
+			d->dest_base += d->ring_size;
+		}
+
+		d->dest_flushed = d->dest;
+		d->dest_end = d->dest_start + 2 * d->ring_size;
+
+		if (d->dest_end - d->dest > d->ring_size) {
+			d->dest_end = d->dest + d->ring_size;
+		}
+
+		return 1;
+	}
+#endif
+
+	keep = d->dest - d->dest_start;
+	if (keep > d->window) {
+		keep = d->window;
+	}
+
+	d->dest_base += (d->dest - keep) - d->dest_start;
+	memmove(d->dest_start, d->dest - keep, keep);
+	d->dest = d->dest_start + keep;
+	d->dest_flushed = d->dest;
+
+	return 1;
+}
+
+/*
+ * Skip count bytes of output that are never written or referred to, by
+ * discarding the window. All of it must be before skip.
+ */
+static void tinf_skip_output(struct tinf_data *d, unsigned long count)
+{
+	d->dest_base = tinf_dest_pos(d) + count;
+	d->dest = d->dest_start;
+	d->dest_flushed = d->dest;
+
+#ifdef TINF_RING
+	if (d->ring_size != 0) {
+		d->dest_end = d->dest_start + d->ring_size;
+	}
+#endif
+}
+
+/*
+ * Grow the output buffer to twice its size, at least TINF_GROW_MIN bytes,
+ * with the grow callback. Returns non-zero on success.
+ */
+static long tinf_grow_output(struct tinf_data *d)
+{
+	unsigned long size = d->dest_end - d->dest_start;
+	unsigned long used = d->dest - d->dest_start;
+	unsigned char *p;
+
+	if (size > ULONG_MAX / 2) {
+		return 0;
+	}
+
+	size = size < TINF_GROW_MIN / 2 ? TINF_GROW_MIN : 2 * size;
+
+	p = (unsigned char *) d->grow(d->dest_start, size, d->grow_opaque);
+
+	if (p == NULL) {
+		d->grow = NULL;
+		return 0;
+	}
+
+	d->dest_start = p;
+	d->dest = p + used;
+	d->dest_end = p + size;
+	d->dest_flushed = d->dest;
+
+	return 1;
+}
+
+/* Move dest to the next non-empty iovec. Returns non-zero on success. */
+static long tinf_next_iov(struct tinf_data *d)
+{
+	unsigned long i = d->iov_index;
+
+	do {
+		if (++i >= d->iov_count) {
+			return 0;
+		}
+	} while (d->iov[i].iov_len == 0);
+
+	d->dest_base += d->dest - d->dest_start;
+	d->iov_index = i;
+
+	d->dest_start = (unsigned char *) d->iov[i].iov_base;
+	d->dest = d->dest_start;
+	d->dest_end = d->dest_start + d->iov[i].iov_len;
+	d->dest_flushed = d->dest;
+
+	return 1;
+}
+
+/*
+ * Make room for more output, by flushing it with a write callback,
+ * growing it with a grow callback, or moving on to the next iovec.
+ * Returns non-zero if room was made.
+ */
+static TINF_NOINLINE long tinf_make_room(struct tinf_data *d)
+{
+	if (d->write != NULL) {
+		return tinf_flush_output(d);
+	}
+
+	if (d->grow != NULL) {
+		return tinf_grow_output(d);
+	}
+
+	if (d->iov != NULL) {
+		return tinf_next_iov(d);
+	}
+
+	return 0;
+}
+
+/*
+ * Copy a match of length bytes at offs when writing to iovecs. Both the
+ * source and the destination of the match may span several iovecs.
+ */
+static TINF_NOINLINE long tinf_copy_iov(struct tinf_data *d, long length,
+                                        long offs)
+{
+	unsigned long back = (unsigned long) offs;
+	unsigned long used = d->dest - d->dest_start;
+	unsigned long i = d->iov_index;
+	const unsigned char *src;
+	const unsigned char *src_end;
+
+	if (back > tinf_dest_pos(d)) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* Find the iovec holding the start of the match */
+	if (back <= used) {
+		src = d->dest - back;
+	}
+	else {
+		back -= used;
+
+		for (;;) {
+			--i;
+
+			if (back <= d->iov[i].iov_len) {
+				break;
+			}
+
+			back -= d->iov[i].iov_len;
+		}
+
+		src = (const unsigned char *) d->iov[i].iov_base
+		    + d->iov[i].iov_len - back;
+	}
+
+	src_end = (const unsigned char *) d->iov[i].iov_base + d->iov[i].iov_len;
+
+	while (length > 0) {
+		long num = length;
+		long k;
+
+		if (d->dest == d->dest_end && !tinf_make_room(d)) {
+			return TINF_BUF_ERROR;
+		}
+
+		while (src == src_end) {
+			++i;
+			src = (const unsigned char *) d->iov[i].iov_base;
+			src_end = src + d->iov[i].iov_len;
+		}
+
+		if (num > d->dest_end - d->dest) {
+			num = d->dest_end - d->dest;
+		}
+
+		if (num > src_end - src) {
+			num = src_end - src;
+		}
+
+		/* Forwards, as source and destination overlap for short offsets */
+		for (k = 0; k < num; ++k) {
+			d->dest[k] = src[k];
+		}
+
+		d->dest += num;
+		src += num;
+		length -= num;
+	}
+
+	return TINF_OK;
+}
+
+/* Non-zero if output goes to a single buffer of fixed size */
+static long tinf_fixed_dest(const struct tinf_data *d)
+{
+	return d->write == NULL && d->grow == NULL && d->iov == NULL;
+}
+
+/*
+ * Called when there is no room for the rest of the output. In prefix mode,
+ * copy the part of a match of length bytes at offs that fits, and stop.
+ */
+static long tinf_output_full(struct tinf_data *d, long length, long offs)
+{
+	long i;
+
+	if (!d->prefix) {
+		return TINF_BUF_ERROR;
+	}
+
+	if (length > d->dest_end - d->dest) {
+		length = d->dest_end - d->dest;
+	}
+
+	for (i = 0; i < length; ++i) {
+		d->dest[i] = d->dest[i - offs];
+	}
+
+	d->dest += length;
+
+	return TINF_OUTPUT_FULL;
+}
+
+/* Number of bytes read from the start of the input */
+static unsigned long tinf_source_pos(const struct tinf_data *d)
+{
+	return d->source_base + (unsigned long) (d->source - d->source_start);
+}
+
+/* -- Decode functions -- */
+
+#ifdef TINF_FAST
+static TINF_HOT tinf_bits tinf_read_le64(const unsigned char *p)
+{
+	return (tinf_bits) p[0]
+	     | ((tinf_bits) p[1] << 8)
+	     | ((tinf_bits) p[2] << 16)
+	     | ((tinf_bits) p[3] << 24)
+	     | ((tinf_bits) p[4] << 32)
+	     | ((tinf_bits) p[5] << 40)
+	     | ((tinf_bits) p[6] << 48)
+	     | ((tinf_bits) p[7] << 56);
+}
+#endif
+
+static TINF_HOT void tinf_refill(struct tinf_data *d, long num)
+{
+	assert(num >= 0 && num <= 32);
+
+#ifdef TINF_FAST
+	/*
+	 * Fill tag with whole bytes from a single load. The bits of the next,
+	 * partly loaded byte end up above bitcount, which is fine since they
+	 * are the same bits the next refill will add.
+	 */
+	if (d->bitcount < num) {
+		if (d->source_end - d->source < 8 && d->read != NULL) {
+			tinf_fill_input(d);
+		}
+
+		if (d->source_end - d->source >= 8) {
+			d->tag |= tinf_read_le64(d->source) << d->bitcount;
+			d->source += (63 - d->bitcount) >> 3;
+			d->bitcount |= 56;
+			return;
+		}
+	}
+#endif
+
+	/* Read bytes until at least num bits available */
+	while (d->bitcount < num) {
+		if (d->source == d->source_end && d->read != NULL) {
+			tinf_fill_input(d);
+		}
+
+		if (d->source != d->source_end) {
+			d->tag |= (tinf_bits) *d->source++ << d->bitcount;
+		}
+		else {
+			/* Add zero bits, only an error if they are used */
+			d->overflow += 8;
+		}
+		d->bitcount += 8;
+	}
+
+	assert(d->bitcount <= TINF_TAG_BITS);
+}
+
+/*
+ * Check if bits past the end of source were used. The bits added by
+ * tinf_refill are the last ones in tag, so this is the case if fewer
+ * bits than that are left.
+ */
+static TINF_HOT int tinf_overrun(const struct tinf_data *d)
+{
+	return d->bitcount < d->overflow;
+}
+
+static TINF_HOT unsigned long
+tinf_getbits_no_refill(struct tinf_data *d, long num)
+{
+	unsigned long bits;
+
+	assert(num >= 0 && num <= d->bitcount);
+
+	/* Get bits from tag */
+	bits = d->tag & ((1UL << num) - 1);
+
+	/* Remove bits from tag */
+	d->tag >>= num;
+	d->bitcount -= num;
+
+	return bits;
+}
+
+/* Get num bits from source stream */
+static TINF_HOT unsigned long tinf_getbits(struct tinf_data *d, long num)
+{
+	tinf_refill(d, num);
+	return tinf_getbits_no_refill(d, num);
+}
+
+/* Read a num bit value from stream and add base */
+static unsigned long tinf_getbits_base(struct tinf_data *d, long num, long base)
+{
+	return base + (num ? tinf_getbits(d, num) : 0);
+}
+
+#ifndef TINF_TABLES
+/* Given a data stream and a tree, decode a symbol */
+static long tinf_decode_symbol(struct tinf_data *d, const struct tinf_tree *t)
+{
+	long base = 0, offs = 0;
+	long len;
+
+	/*
+	 * Get more bits while code index is above number of codes
+	 *
+	 * Rather than the actual code, we are computing the position of the
+	 * code in the sorted order of codes, which is the index of the
+	 * corresponding symbol.
+	 *
+	 * Conceptually, for each code length (level in the tree), there are
+	 * counts[len] leaves on the left and longernal nodes on the right.
+	 * The index we have decoded so far is base + offs, and if that
+	 * falls within the leaves we are done. Otherwise we adjust the range
+	 * of offs and add one more bit to it.
+	 */
+	for (len = 1; ; ++len) {
+		offs = 2 * offs + tinf_getbits(d, 1);
+
+		assert(len <= 15);
+
+		if (offs < t->counts[len]) {
+			break;
+		}
+
+		base += t->counts[len];
+		offs -= t->counts[len];
+	}
+
+	assert(base + offs >= 0 && base + offs < 288);
+
+	return t->symbols[base + offs];
+}
+#else
+/*
+ * Given a data stream and a table, look up the root table entry for the
+ * next code. The bits of the entry are not removed.
+ */
+static TINF_HOT struct tinf_entry
+tinf_peek_entry(const struct tinf_data *d, const struct tinf_entry *table,
+                long root)
+{
+	return table[d->tag & ((1UL << root) - 1)];
+}
+
+/*
+ * Given a root table entry, look up the sub-table entry if the code is
+ * longer than root bits. At least 15 bits must be available.
+ */
+static TINF_HOT struct tinf_entry
+tinf_resolve_entry(struct tinf_data *d, const struct tinf_entry *table,
+                   struct tinf_entry e, long root)
+{
+	assert(d->bitcount >= 15);
+
+	if ((e.op & 0xF0) == TINF_OP_SUB) {
+		tinf_getbits_no_refill(d, root);
+
+		e = table[e.value + (d->tag & ((1UL << (e.op & 0x0F)) - 1))];
+	}
+
+	return e;
+}
+
+/*
+ * Given a data stream and a table, look up the entry for the next code.
+ * The bits of the entry are not removed. At least 15 bits must be
+ * available.
+ */
+static TINF_HOT struct tinf_entry
+tinf_decode_entry(struct tinf_data *d, const struct tinf_entry *table,
+                  long root)
+{
+	return tinf_resolve_entry(d, table, tinf_peek_entry(d, table, root),
+	                          root);
+}
+#endif
+
+/*
+ * Given a data stream, decode the code lengths of the dynamic trees from it.
+ *
+ * The code length tree is built in the literal/length tree. The hash is
+ * computed over the runs of code lengths, which is cheaper than hashing
+ * every length.
+ */
+static long tinf_decode_lengths(struct tinf_data *d, unsigned char *lengths,
+                                unsigned long *phlit, unsigned long *phdist,
+                                unsigned long *phash)
+{
+#ifdef TINF_TABLES
+	struct tinf_tree *lt = &d->ltree;
+#else
+	struct tinf_tree *lt = &d->codes.ltree;
+#endif
+	struct tinf_clen_entry table[128];
+
+	/* Special ordering of code length codes */
+	static const unsigned char clcidx[19] = {
+		16, 17, 18, 0,  8, 7,  9, 6, 10, 5,
+		11,  4, 12, 3, 13, 2, 14, 1, 15
+	};
+
+	unsigned long hlit, hdist, hclen;
+	unsigned long i, num, length;
+	unsigned long hash = 2166136261UL;
+	long res;
+
+	/* Get 5 bits HLIT (257-286) */
+	hlit = tinf_getbits_base(d, 5, 257);
+
+	/* Get 5 bits HDIST (1-32) */
+	hdist = tinf_getbits_base(d, 5, 1);
+
+	/* Get 4 bits HCLEN (4-19) */
+	hclen = tinf_getbits_base(d, 4, 4);
+
+	/*
+	 * The RFC limits the range of HLIT to 286, but lists HDIST as range
+	 * 1-32, even though distance codes 30 and 31 have no meaning. While
+	 * we could allow the full range of HLIT and HDIST to make it possible
+	 * to decode the fixed trees with this function, we consider it an
+	 * error here.
+	 *
+	 * See also: https://github.com/madler/zlib/issues/82
+	 */
+	if (hlit > 286 || hdist > 30) {
+		return TINF_DATA_ERROR;
+	}
+
+	for (i = 0; i < 19; ++i) {
+		lengths[i] = 0;
+	}
+
+	/* Read code lengths for code length alphabet */
+	for (i = 0; i < hclen; ++i) {
+		/* Get 3 bits code length (0-7) */
+		unsigned long clen = tinf_getbits(d, 3);
+
+		lengths[clcidx[i]] = clen;
+	}
+
+	/* Build code length tree (in literal/length tree to save space) */
+	res = tinf_build_tree(lt, lengths, 19);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* Check code length tree is not empty */
+	if (lt->max_sym == -1) {
+		return TINF_DATA_ERROR;
+	}
+
+	tinf_build_clen_table(lt, table);
+
+	/* Decode code lengths for the dynamic trees */
+	for (num = 0; num < hlit + hdist; ) {
+		struct tinf_clen_entry e;
+		long sym;
+
+		/* Symbol and repeat count take at most 7 + 7 bits */
+		tinf_refill(d, 14);
+
+		e = table[d->tag & 127];
+		sym = e.sym;
+
+		if (sym > lt->max_sym) {
+			return TINF_DATA_ERROR;
+		}
+
+		length = e.base + ((d->tag >> (e.bits - e.extra))
+		                   & ((1UL << e.extra) - 1));
+
+		tinf_getbits_no_refill(d, e.bits);
+
+		switch (sym) {
+		case 16:
+			/* Copy previous code length 3-6 times */
 			if (num == 0) {
 				return TINF_DATA_ERROR;
 			}
-			sym = lengths[num - 1];
-			length = tinf_getbits_base(d, 2, 3);
+			sym = lengths[num - 1];
+			break;
+		case 17:
+		case 18:
+			/* Repeat code length 0 for 3-10 or 11-138 times */
+			sym = 0;
+			break;
+		default:
+			/* Values 0-15 represent the actual code lengths */
+			break;
+		}
+
+		if (length > hlit + hdist - num) {
+			return TINF_DATA_ERROR;
+		}
+
+		/* FNV-1a step on the run */
+		hash = ((hash ^ ((unsigned long) sym << 8 | length)) * 16777619UL)
+		     & 0xFFFFFFFFUL;
+
+		while (length--) {
+			lengths[num++] = sym;
+		}
+	}
+
+	/* Check EOB symbol is present */
+	if (lengths[256] == 0) {
+		return TINF_DATA_ERROR;
+	}
+
+	*phlit = hlit;
+	*phdist = hdist;
+	*phash = hash;
+
+	return TINF_OK;
+}
+
+/* Build dynamic codes from code lengths */
+static long tinf_build_dynamic_codes(struct tinf_data *d, struct tinf_codes *c,
+                                     const unsigned char *lengths,
+                                     unsigned long hlit, unsigned long hdist)
+{
+#ifdef TINF_TABLES
+	struct tinf_tree *lt = &d->ltree;
+	struct tinf_tree *dt = &d->dtree;
+#else
+	struct tinf_tree *lt = &c->ltree;
+	struct tinf_tree *dt = &c->dtree;
+#endif
+	long res = tinf_build_tree(lt, lengths, hlit);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	res = tinf_build_tree(dt, lengths + hlit, hdist);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+#ifdef TINF_TABLES
+	tinf_build_codes(c, lt, dt);
+#else
+	(void) d;
+#endif
+
+	return TINF_OK;
+}
+
+/*
+ * Given a data stream, decode dynamic trees from it, and set *pc to point to
+ * the codes
+ */
+static long tinf_decode_trees(struct tinf_data *d, struct tinf_codes **pc)
+{
+	unsigned char lengths[288 + 32];
+	unsigned long hlit, hdist, hash;
+	long res;
+#if TINF_TREE_CACHE > 0
+	struct tinf_tree_cache_entry *e;
+	long i;
+#endif
+
+	res = tinf_decode_lengths(d, lengths, &hlit, &hdist, &hash);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+#if TINF_TREE_CACHE > 0
+	/* Look for trees built from the same code lengths */
+	for (i = 0; i < TINF_TREE_CACHE; ++i) {
+		e = &d->cache[i];
+
+		if (e->hash == hash && e->hlit == hlit && e->hdist == hdist
+		 && memcmp(e->lengths, lengths, hlit + hdist) == 0) {
+			*pc = &e->codes;
+			return TINF_OK;
+		}
+	}
+
+	/* Build trees in the oldest entry */
+	e = &d->cache[d->cache_next];
+	e->hdist = 0;
+
+	res = tinf_build_dynamic_codes(d, &e->codes, lengths, hlit, hdist);
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	e->hash = hash;
+	e->hlit = hlit;
+	e->hdist = hdist;
+	memcpy(e->lengths, lengths, hlit + hdist);
+
+	d->cache_next = (d->cache_next + 1) % TINF_TREE_CACHE;
+
+	*pc = &e->codes;
+
+	return TINF_OK;
+#else
+#  ifdef TINF_TABLES
+	d->codes_fixed = 0;
+#  endif
+	*pc = &d->codes;
+
+	return tinf_build_dynamic_codes(d, *pc, lengths, hlit, hdist);
+#endif
+}
+
+/* Number of input bits consumed */
+static unsigned long tinf_bit_offset(const struct tinf_data *d)
+{
+	return 8 * tinf_source_pos(d) - (d->bitcount - d->overflow);
+}
+
+#ifdef TINF_BLOCK_STATS
+/* -- Block statistics -- */
+
+/* Reset statistics before reading a block header */
+static void tinf_stats_start(struct tinf_data *d)
+{
+	unsigned long i;
+
+	d->stats.type = -1;
+	d->stats.in_start = tinf_bit_offset(d);
+	d->stats.out_start = tinf_dest_pos(d);
+	d->stats.literals = 0;
+	d->stats.matches = 0;
+
+	for (i = 0; i < 29; ++i) {
+		d->stats.length_counts[i] = 0;
+	}
+	for (i = 0; i < 30; ++i) {
+		d->stats.dist_counts[i] = 0;
+	}
+
+	d->stats.tree_time = 0;
+	d->block_clock = TINF_STATS_CLOCK();
+}
+
+#ifdef TINF_TABLES
+/*
+ * Count a match, the table entries give length and offset, not codes. A
+ * length of 258 is counted as code 285.
+ */
+static void tinf_stats_match(struct tinf_data *d, long length, long offs)
+{
+	long sym = 28, dist = 29;
+
+	while (length_base[sym] > length) {
+		--sym;
+	}
+	while (dist_base[dist] > offs) {
+		--dist;
+	}
+
+	d->stats.matches++;
+	d->stats.length_counts[sym]++;
+	d->stats.dist_counts[dist]++;
+}
+#endif
+
+/*
+ * Record time spent reading and building dynamic trees, the rest of the
+ * block, including fixed trees, is decode time
+ */
+static void tinf_stats_trees_done(struct tinf_data *d)
+{
+	d->stats.tree_time = TINF_STATS_CLOCK() - d->block_clock;
+}
+
+/* Complete statistics for a block and pass them to the callback */
+static void tinf_stats_end(struct tinf_data *d, long btype)
+{
+	d->stats.decode_time = TINF_STATS_CLOCK() - d->block_clock
+	                     - d->stats.tree_time;
+	d->stats.type = btype;
+	d->stats.in_end = tinf_bit_offset(d);
+	d->stats.out_end = tinf_dest_pos(d);
+
+	if (tinf_block_cb) {
+		tinf_block_cb(&d->stats, tinf_block_cb_opaque);
+	}
+}
+#endif
+
+/* -- Block inflate functions -- */
+
+#ifdef TINF_TABLES
+/*
+ * Match copy functions. With the distance at least as long as the vector
+ * size, each load only reads bytes that are already written, and the last
+ * vector is copied ending at the end of the match, so nothing is written
+ * past it.
+ */
+static TINF_ALWAYS_INLINE void
+tinf_copy_bytes(unsigned char *dest, long offs, long length)
+{
+	long i;
+
+	for (i = 0; i < length; ++i) {
+		dest[i] = dest[i - offs];
+	}
+}
+
+#ifdef TINF_X86
+static __attribute__((target("sse4.2"))) TINF_ALWAYS_INLINE void
+tinf_copy_sse42(unsigned char *dest, long offs, long length)
+{
+	long i;
+
+	if (offs < 16 || length < 16) {
+		tinf_copy_bytes(dest, offs, length);
+		return;
+	}
+
+	for (i = 0; i < length - 16; i += 16) {
+		_mm_storeu_si128((__m128i *) (dest + i),
+		                 _mm_loadu_si128((const __m128i *) (dest + i - offs)));
+	}
+
+	i = length - 16;
+	_mm_storeu_si128((__m128i *) (dest + i),
+	                 _mm_loadu_si128((const __m128i *) (dest + i - offs)));
+}
+
+static __attribute__((target("avx2"))) TINF_ALWAYS_INLINE void
+tinf_copy_avx2(unsigned char *dest, long offs, long length)
+{
+	long i;
+
+	if (offs < 32 || length < 32) {
+		tinf_copy_sse42(dest, offs, length);
+		return;
+	}
+
+	for (i = 0; i < length - 32; i += 32) {
+		_mm256_storeu_si256((__m256i *) (dest + i),
+		        _mm256_loadu_si256((const __m256i *) (dest + i - offs)));
+	}
+
+	i = length - 32;
+	_mm256_storeu_si256((__m256i *) (dest + i),
+	        _mm256_loadu_si256((const __m256i *) (dest + i - offs)));
+}
+
+static __attribute__((target("avx512f,avx512bw,avx2"))) TINF_ALWAYS_INLINE void
+tinf_copy_avx512(unsigned char *dest, long offs, long length)
+{
+	long i;
+
+	if (offs < 64 || length < 64) {
+		tinf_copy_avx2(dest, offs, length);
+		return;
+	}
+
+	for (i = 0; i < length - 64; i += 64) {
+		_mm512_storeu_si512((void *) (dest + i),
+		        _mm512_loadu_si512((const void *) (dest + i - offs)));
+	}
+
+	i = length - 64;
+	_mm512_storeu_si512((void *) (dest + i),
+	        _mm512_loadu_si512((const void *) (dest + i - offs)));
+}
+#endif
+
+#ifdef TINF_NEON
+static TINF_ALWAYS_INLINE void
+tinf_copy_neon(unsigned char *dest, long offs, long length)
+{
+	long i;
+
+	if (offs < 16 || length < 16) {
+		tinf_copy_bytes(dest, offs, length);
+		return;
+	}
+
+	for (i = 0; i < length - 16; i += 16) {
+		vst1q_u8(dest + i, vld1q_u8(dest + i - offs));
+	}
+
+	i = length - 16;
+	vst1q_u8(dest + i, vld1q_u8(dest + i - offs));
+}
+#endif
+
+/*
+ * Decode loop variants, selected at run time by tinf_cpu_tier. The bit
+ * reader is inlined into each, so for instance the AVX2 variant also gets
+ * BMI2 shifts and masks.
+ */
+#define TINF_LOOP_NAME tinf_inflate_block_scalar
+#define TINF_LOOP_ATTR
+#define TINF_LOOP_COPY(dest, offs, length) tinf_copy_bytes(dest, offs, length)
+#include "tinfloop.h"
+
+#ifdef TINF_X86
+#define TINF_LOOP_NAME tinf_inflate_block_sse42
+#define TINF_LOOP_ATTR __attribute__((target("sse4.2")))
+#define TINF_LOOP_COPY(dest, offs, length) tinf_copy_sse42(dest, offs, length)
+#include "tinfloop.h"
+
+#define TINF_LOOP_NAME tinf_inflate_block_avx2
+#define TINF_LOOP_ATTR __attribute__((target("avx2,bmi2")))
+#define TINF_LOOP_COPY(dest, offs, length) tinf_copy_avx2(dest, offs, length)
+#include "tinfloop.h"
+
+#define TINF_LOOP_NAME tinf_inflate_block_avx512
+#define TINF_LOOP_ATTR __attribute__((target("avx512f,avx512bw,avx2,bmi2")))
+#define TINF_LOOP_COPY(dest, offs, length) tinf_copy_avx512(dest, offs, length)
+#include "tinfloop.h"
+#endif
+
+#ifdef TINF_NEON
+#define TINF_LOOP_NAME tinf_inflate_block_neon
+#define TINF_LOOP_ATTR
+#define TINF_LOOP_COPY(dest, offs, length) tinf_copy_neon(dest, offs, length)
+#include "tinfloop.h"
+#endif
+#endif
+
+/* Given a stream and codes, inflate a block of data */
+static long tinf_inflate_block_data(struct tinf_data *d,
+                                   const struct tinf_codes *c)
+{
+#ifdef TINF_TABLES
+	for (;;) {
+		long res;
+
+		switch (tinf_cpu_tier()) {
+#  ifdef TINF_X86
+		case TINF_CPU_AVX512:
+			res = tinf_inflate_block_avx512(d, c);
+			break;
+		case TINF_CPU_AVX2:
+			res = tinf_inflate_block_avx2(d, c);
+			break;
+		case TINF_CPU_SSE42:
+			res = tinf_inflate_block_sse42(d, c);
+			break;
+#  endif
+#  ifdef TINF_NEON
+		case TINF_CPU_NEON:
+			res = tinf_inflate_block_neon(d, c);
+			break;
+#  endif
+		default:
+			res = tinf_inflate_block_scalar(d, c);
+			break;
+		}
+
+		/*
+		 * The loop leaves the flushing to here, so it does not have to
+		 * keep its state across a call. Write the symbol it had no room
+		 * for, and continue with the next.
+		 */
+		if (res != TINF_FULL) {
+			return res;
+		}
+
+		if (d->pending_offs == 0) {
+			if (!tinf_make_room(d)) {
+				return tinf_output_full(d, 0, 0);
+			}
+
+			*d->dest++ = (unsigned char) d->pending_length;
+
+			TINF_STAT(d->stats.literals++);
+			continue;
+		}
+
+		/* The length and distance may have been read past the input */
+		if (tinf_overrun(d)) {
+			return TINF_DATA_ERROR;
+		}
+
+		TINF_STAT(tinf_stats_match(d, d->pending_length, d->pending_offs));
+
+		if (d->iov != NULL) {
+			res = tinf_copy_iov(d, d->pending_length, d->pending_offs);
+
+			if (res != TINF_OK) {
+				return res;
+			}
+			continue;
+		}
+
+		if (d->pending_offs > d->dest - d->dest_start
+		 || (unsigned long) d->pending_offs > d->window) {
+			return TINF_DATA_ERROR;
+		}
+
+		if (!tinf_make_room(d)) {
+			return tinf_output_full(d, d->pending_length, d->pending_offs);
+		}
+
+		/* Flushing a window smaller than 32 KiB may not keep offs bytes */
+		if (d->pending_offs > d->dest - d->dest_start) {
+			return TINF_DATA_ERROR;
+		}
+
+		tinf_copy_bytes(d->dest, d->pending_offs, d->pending_length);
+
+		d->dest += d->pending_length;
+	}
+#else
+	const struct tinf_tree *lt = &c->ltree;
+	const struct tinf_tree *dt = &c->dtree;
+
+	for (;;) {
+		long sym = tinf_decode_symbol(d, lt);
+
+		/* Check for overflow in bit reader */
+		if (tinf_overrun(d)) {
+			return TINF_DATA_ERROR;
+		}
+
+		if (sym < 256) {
+			if (d->dest == d->dest_end && !tinf_make_room(d)) {
+				return tinf_output_full(d, 0, 0);
+			}
+			*d->dest++ = sym;
+
+			TINF_STAT(d->stats.literals++);
+		}
+		else {
+			long length, dist, offs;
+			long i;
+
+			/* Check for end of block */
+			if (sym == 256) {
+				return TINF_OK;
+			}
+
+			/* Check sym is within range and distance tree is not empty */
+			if (sym > lt->max_sym || sym - 257 > 28 || dt->max_sym == -1) {
+				return TINF_DATA_ERROR;
+			}
+
+			sym -= 257;
+
+			/* Possibly get more bits from length code */
+			length = tinf_getbits_base(d, length_bits[sym],
+			                           length_base[sym]);
+
+			dist = tinf_decode_symbol(d, dt);
+
+			/* Check dist is within range */
+			if (dist > dt->max_sym || dist > 29) {
+				return TINF_DATA_ERROR;
+			}
+
+			/* Possibly get more bits from distance code */
+			offs = tinf_getbits_base(d, dist_bits[dist],
+			                         dist_base[dist]);
+
+			TINF_STAT(d->stats.matches++);
+			TINF_STAT(d->stats.length_counts[sym]++);
+			TINF_STAT(d->stats.dist_counts[dist]++);
+
+			/* Matches that do not fit in the current iovec */
+			if (d->iov != NULL
+			 && (offs > d->dest - d->dest_start
+			  || d->dest_end - d->dest < length)) {
+				long res = tinf_copy_iov(d, length, offs);
+
+				if (res != TINF_OK) {
+					return res;
+				}
+				continue;
+			}
+
+			if (offs > d->dest - d->dest_start
+			 || (unsigned long) offs > d->window) {
+				return TINF_DATA_ERROR;
+			}
+
+			if (d->dest_end - d->dest < length) {
+				/* Do not write a match read past the input */
+				if (tinf_overrun(d)) {
+					return TINF_DATA_ERROR;
+				}
+
+				if (!tinf_make_room(d)) {
+					return tinf_output_full(d, length, offs);
+				}
+
+				/* A small window may keep fewer than offs bytes */
+				if (offs > d->dest - d->dest_start) {
+					return TINF_DATA_ERROR;
+				}
+			}
+
+			/* Copy match */
+			for (i = 0; i < length; ++i) {
+				d->dest[i] = d->dest[i - offs];
+			}
+
+			d->dest += length;
+		}
+	}
+#endif
+}
+
+/* Inflate an uncompressed block of data */
+static long tinf_inflate_uncompressed_block(struct tinf_data *d)
+{
+	unsigned long length, invlength;
+
+	if (tinf_overrun(d)) {
+		return TINF_DATA_ERROR;
+	}
+
+	/*
+	 * Skip to the next byte boundary, and return any whole bytes that were
+	 * read ahead to source
+	 */
+	d->source -= (d->bitcount - d->overflow) >> 3;
+	d->tag = 0;
+	d->bitcount = 0;
+	d->overflow = 0;
+
+	while (d->source_end - d->source < 4) {
+		if (tinf_fill_input(d) == 0) {
+			return TINF_DATA_ERROR;
+		}
+	}
+
+	/* Get length */
+	length = read_le16(d->source);
+
+	/* Get one's complement of length */
+	invlength = read_le16(d->source + 2);
+
+	/* Check length */
+	if (length != (~invlength & 0x0000FFFF)) {
+		return TINF_DATA_ERROR;
+	}
+
+	d->source += 4;
+
+	/*
+	 * With a read callback, or in prefix mode where the output may fill
+	 * first, missing input is found while copying
+	 */
+	if (d->read == NULL && !d->prefix && d->source_end - d->source < length) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* Unless room can be made or the output cut short while copying */
+	if (tinf_fixed_dest(d) && !d->prefix && d->dest_end - d->dest < length) {
+		return TINF_BUF_ERROR;
+	}
+
+	/*
+	 * Output that is skipped and not in the last 32 KiB of the block is
+	 * not copied, as nothing refers to it
+	 */
+	if (d->skip > tinf_dest_pos(d) && length > d->window && d->read == NULL) {
+		unsigned long num = d->skip - tinf_dest_pos(d);
+
+		if (num > length - d->window) {
+			num = length - d->window;
+		}
+
+		tinf_skip_output(d, num);
+
+		d->source += num;
+		length -= num;
+	}
+
+	/* Copy block */
+	while (length > 0) {
+		unsigned long num;
+
+		if (d->dest == d->dest_end && !tinf_make_room(d)) {
+			return tinf_output_full(d, 0, 0);
+		}
+
+		num = d->source_end - d->source;
+
+		if (num == 0 && (num = tinf_fill_input(d)) == 0) {
+			return TINF_DATA_ERROR;
+		}
+
+		if (num > length) {
+			num = length;
+		}
+
+		if (num > (unsigned long) (d->dest_end - d->dest)) {
+			num = d->dest_end - d->dest;
+		}
+
+		memcpy(d->dest, d->source, num);
+
+		d->dest += num;
+		d->source += num;
+		length -= num;
+	}
+
+	return TINF_OK;
+}
+
+/* Inflate a block of data compressed with fixed Huffman trees */
+static long tinf_inflate_fixed_block(struct tinf_data *d)
+{
+#ifdef TINF_TABLES
+	/* Build fixed tables, unless already built for a previous block */
+	if (!d->codes_fixed) {
+		tinf_build_fixed_trees(&d->ltree, &d->dtree);
+		tinf_build_codes(&d->codes, &d->ltree, &d->dtree);
+		d->codes_fixed = 1;
+	}
+#else
+	/* Build fixed Huffman trees */
+	tinf_build_fixed_trees(&d->codes.ltree, &d->codes.dtree);
+#endif
+
+	/* Decode block using fixed trees */
+	return tinf_inflate_block_data(d, &d->codes);
+}
+
+/* Inflate a block of data compressed with dynamic Huffman trees */
+static long tinf_inflate_dynamic_block(struct tinf_data *d)
+{
+	struct tinf_codes *c;
+	long res;
+
+	TINF_PROBE1(trees_start, tinf_bit_offset(d));
+
+	/* Decode trees from stream */
+	res = tinf_decode_trees(d, &c);
+
+	TINF_PROBE2(trees_end, res, tinf_bit_offset(d));
+
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	TINF_STAT(tinf_stats_trees_done(d));
+
+	/* Decode block using decoded trees */
+	return tinf_inflate_block_data(d, c);
+}
+
+/* -- Public functions -- */
+
+/* Initialize global (static) data */
+void tinf_init(void)
+{
+	return;
+}
+
+#ifdef TINF_BLOCK_STATS
+void tinf_set_block_callback(tinf_block_callback cb, void *opaque)
+{
+	tinf_block_cb = cb;
+	tinf_block_cb_opaque = opaque;
+}
+#endif
+
+/* Inflate blocks until the final block */
+static long tinf_inflate_blocks(struct tinf_data *d)
+{
+	long bfinal;
+
+	do {
+		unsigned long btype;
+		long res;
+
+		TINF_PROBE2(block_start, tinf_bit_offset(d), tinf_dest_pos(d));
+		TINF_STAT(tinf_stats_start(d));
+
+		/* Read final block flag */
+		bfinal = tinf_getbits(d, 1);
+
+		/* Read block type (2 bits) */
+		btype = tinf_getbits(d, 2);
+
+		/* Decompress block */
+		switch (btype) {
+		case 0:
+			/* Decompress uncompressed block */
+			res = tinf_inflate_uncompressed_block(d);
 			break;
-		case 17:
-			/* Repeat code length 0 for 3-10 times (read 3 bits) */
-			sym = 0;
-			length = tinf_getbits_base(d, 3, 3);
+		case 1:
+			/* Decompress block with fixed Huffman trees */
+			res = tinf_inflate_fixed_block(d);
 			break;
-		case 18:
-			/* Repeat code length 0 for 11-138 times (read 7 bits) */
-			sym = 0;
-			length = tinf_getbits_base(d, 7, 11);
+		case 2:
+			/* Decompress block with dynamic Huffman trees */
+			res = tinf_inflate_dynamic_block(d);
 			break;
 		default:
-			/* Values 0-15 represent the actual code lengths */
-			length = 1;
+			res = TINF_DATA_ERROR;
 			break;
 		}
 
-		if (length > hlit + hdist - num) {
-			return TINF_DATA_ERROR;
-		}
+		if (res != TINF_OK) {
+			return res;
+		}
+
+		TINF_COUNT_BLOCK(btype);
+		TINF_STAT(tinf_stats_end(d, btype));
+		TINF_PROBE3(block_end, btype, tinf_bit_offset(d), tinf_dest_pos(d));
+	} while (!bfinal);
+
+	/* Check for overflow in bit reader */
+	if (tinf_overrun(d)) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+/* Initialise stream data for decompressing to dest, without input */
+static void tinf_start(struct tinf_data *d, void *dest, unsigned long destLen)
+{
+#if TINF_TREE_CACHE > 0
+	long i;
+#endif
+
+	d->source = NULL;
+	d->source_start = NULL;
+	d->source_end = NULL;
+	d->source_base = 0;
+	d->read = NULL;
+	d->tag = 0;
+	d->bitcount = 0;
+	d->overflow = 0;
+
+	d->dest = (unsigned char *) dest;
+	d->dest_start = d->dest;
+	d->dest_end = d->dest + destLen;
+	d->dest_base = 0;
+	d->write = NULL;
+	d->dest_flushed = d->dest;
+	d->skip = 0;
+	d->window = 32768;
+	d->grow = NULL;
+	d->prefix = 0;
+	d->iov = NULL;
+	d->iov_count = 0;
+	d->iov_index = 0;
+#ifdef TINF_RING
+	d->ring_size = 0;
+#endif
+
+#ifdef TINF_TABLES
+	d->codes_fixed = 0;
+#endif
+
+#if TINF_TREE_CACHE > 0
+	for (i = 0; i < TINF_TREE_CACHE; ++i) {
+		d->cache[i].hdist = 0;
+	}
+	d->cache_next = 0;
+#endif
+}
+
+/* Inflate all blocks of the stream, and set destLen on success */
+static long tinf_finish(struct tinf_data *d, unsigned long *destLen)
+{
+	long res = tinf_inflate_blocks(d);
+
+	/* Write the rest of the output */
+	if (res == TINF_OK && d->write != NULL && !tinf_flush_output(d)) {
+		res = TINF_BUF_ERROR;
+	}
+
+	TINF_PROBE3(stream_end, res, tinf_source_pos(d), tinf_dest_pos(d));
+
+	if (res == TINF_OK || res == TINF_OUTPUT_FULL) {
+		*destLen = tinf_dest_pos(d);
+	}
+
+	return res;
+}
+
+/* Inflate stream from source to dest */
+long tinf_inflate(void *dest, unsigned long *destLen,
+                  const void *source, unsigned long sourceLen)
+{
+	struct tinf_data d;
+
+	tinf_start(&d, dest, *destLen);
+
+	d.source = (const unsigned char *) source;
+	d.source_start = d.source;
+	d.source_end = d.source + sourceLen;
+
+	TINF_PROBE4(stream_start, source, sourceLen, dest, *destLen);
+
+	return tinf_finish(&d, destLen);
+}
+
+long tinf_inflate_bits(void *dest, unsigned long *destLen,
+                       const void *source, unsigned long sourceLen,
+                       unsigned long *endBit)
+{
+	struct tinf_data d;
+	long res;
+
+	tinf_start(&d, dest, *destLen);
+
+	d.source = (const unsigned char *) source;
+	d.source_start = d.source;
+	d.source_end = d.source + sourceLen;
+
+	TINF_PROBE4(stream_start, source, sourceLen, dest, *destLen);
+
+	res = tinf_finish(&d, destLen);
+
+	if (res == TINF_OK) {
+		*endBit = tinf_bit_offset(&d);
+	}
+
+	return res;
+}
+
+long tinf_uncompress(void *dest, unsigned long *destLen,
+                    const void *source, unsigned long sourceLen)
+{
+	long res = tinf_inflate(dest, destLen, source, sourceLen);
+
+	TINF_COUNT_CALL(TINF_API_UNCOMPRESS, sourceLen, *destLen, res);
 
-		while (length--) {
-			lengths[num++] = sym;
-		}
+	return res;
+}
+
+long tinf_uncompress_read(void *dest, unsigned long *destLen,
+                          tinf_read_callback read, void *opaque)
+{
+	unsigned char buf[TINF_READ_BUF_SIZE];
+	struct tinf_data d;
+	long res;
+
+	tinf_start(&d, dest, *destLen);
+
+	d.source = buf;
+	d.source_start = buf;
+	d.source_end = buf;
+	d.read = read;
+	d.read_opaque = opaque;
+	d.in_buf = buf;
+
+	TINF_PROBE4(stream_start, NULL, 0, dest, *destLen);
+
+	res = tinf_finish(&d, destLen);
+
+	TINF_COUNT_CALL(TINF_API_UNCOMPRESS_READ,
+	                d.source_base + (d.source_end - d.source_start),
+	                *destLen, res);
+
+	return res;
+}
+
+#ifdef TINF_RING
+/* Size of the ring window, TINF_RING_SIZE rounded up to whole pages */
+static unsigned long tinf_ring_size(void)
+{
+	long page = sysconf(_SC_PAGESIZE);
+
+	if (page <= 0) {
+		return TINF_RING_SIZE;
 	}
 
-	/* Check EOB symbol is present */
-	if (lengths[256] == 0) {
-		return TINF_DATA_ERROR;
+	return (TINF_RING_SIZE + page - 1) / page * page;
+}
+
+/*
+ * Map size bytes of a memfd twice in a row, so output and matches can run
+ * past the end of the window into the same memory, instead of the window
+ * being moved down when flushed. Returns NULL on failure.
+ */
+static unsigned char *tinf_ring_map(unsigned long size)
+{
+	unsigned char *p;
+	void *m;
+	int fd;
+
+	fd = memfd_create("tinf", MFD_CLOEXEC);
+
+	if (fd < 0) {
+		return NULL;
 	}
 
-	/* Build dynamic trees */
-	res = tinf_build_tree(lt, lengths, hlit);
+	/* Reserve address space for both, then map the memfd over it */
+	m = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-	if (res != TINF_OK) {
-		return res;
+	if (m == MAP_FAILED) {
+		close(fd);
+		return NULL;
 	}
 
-	res = tinf_build_tree(dt, lengths + hlit, hdist);
+	p = (unsigned char *) m;
 
-	if (res != TINF_OK) {
-		return res;
+	if (ftruncate(fd, (off_t) size) != 0
+	 || mmap(p, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+	         fd, 0) == MAP_FAILED
+	 || mmap(p + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+	         fd, 0) == MAP_FAILED
+	 || madvise(p, 2 * size, MADV_DONTFORK) != 0) {
+		munmap(m, 2 * size);
+		p = NULL;
 	}
 
-	return TINF_OK;
+	close(fd);
+
+	return p;
 }
 
-/* -- Block inflate functions -- */
+/*
+ * Each thread keeps the ring of its last call, so only the first call on
+ * a thread maps one. A call made from inside a write callback maps its
+ * own, as the ring is taken while in use. The ring is unmapped when the
+ * thread exits.
+ *
+ * The memfd is shared, so a child created by fork would write to the same
+ * memory as the parent. Rings are not passed on to children, and a child
+ * forgets the ring its thread kept and maps a new one.
+ */
+static pthread_once_t tinf_ring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tinf_ring_key;
+static int tinf_ring_keyed = 0;
 
-/* Given a stream and two trees, inflate a block of data */
-static long tinf_inflate_block_data(struct tinf_data *d, struct tinf_tree *lt,
-                                   struct tinf_tree *dt)
+static void tinf_ring_free(void *p)
 {
-	/* Extra bits and base tables for length codes */
-	static const unsigned char length_bits[30] = {
-		0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
-		1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
-		4, 4, 4, 4, 5, 5, 5, 5, 0, 127
-	};
+	munmap(p, 2 * tinf_ring_size());
+}
 
-	static const unsigned short length_base[30] = {
-		 3,  4,  5,   6,   7,   8,   9,  10,  11,  13,
-		15, 17, 19,  23,  27,  31,  35,  43,  51,  59,
-		67, 83, 99, 115, 131, 163, 195, 227, 258,   0
-	};
+/* Called in the child after fork, where the ring is not mapped */
+static void tinf_ring_forget(void)
+{
+	pthread_setspecific(tinf_ring_key, NULL);
+}
 
-	/* Extra bits and base tables for distance codes */
-	static const unsigned char dist_bits[30] = {
-		0, 0,  0,  0,  1,  1,  2,  2,  3,  3,
-		4, 4,  5,  5,  6,  6,  7,  7,  8,  8,
-		9, 9, 10, 10, 11, 11, 12, 12, 13, 13
-	};
+static void tinf_ring_init(void)
+{
+	tinf_ring_keyed = pthread_key_create(&tinf_ring_key,
+	                                     tinf_ring_free) == 0
+	               && pthread_atfork(NULL, NULL, tinf_ring_forget) == 0;
+}
 
-	static const unsigned short dist_base[30] = {
-		   1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
-		  33,   49,   65,   97,  129,  193,  257,   385,   513,   769,
-		1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
-	};
+/* Take the ring of the calling thread, or map a new one */
+static unsigned char *tinf_ring_get(unsigned long size)
+{
+	unsigned char *ring;
 
-	for (;;) {
-		long sym = tinf_decode_symbol(d, lt);
+	pthread_once(&tinf_ring_once, tinf_ring_init);
 
-		/* Check for overflow in bit reader */
-		if (d->overflow) {
-			return TINF_DATA_ERROR;
-		}
+	if (tinf_ring_keyed) {
+		ring = (unsigned char *) pthread_getspecific(tinf_ring_key);
 
-		if (sym < 256) {
-			if (d->dest == d->dest_end) {
-				return TINF_BUF_ERROR;
-			}
-			*d->dest++ = sym;
+		if (ring != NULL) {
+			pthread_setspecific(tinf_ring_key, NULL);
+			return ring;
 		}
-		else {
-			long length, dist, offs;
-			long i;
+	}
 
-			/* Check for end of block */
-			if (sym == 256) {
-				return TINF_OK;
-			}
+	return tinf_ring_map(size);
+}
 
-			/* Check sym is within range and distance tree is not empty */
-			if (sym > lt->max_sym || sym - 257 > 28 || dt->max_sym == -1) {
-				return TINF_DATA_ERROR;
-			}
+/* Keep the ring for the next call, unless the thread already has one */
+static void tinf_ring_put(unsigned char *ring, unsigned long size)
+{
+	if (tinf_ring_keyed && pthread_getspecific(tinf_ring_key) == NULL
+	 && pthread_setspecific(tinf_ring_key, ring) == 0) {
+		return;
+	}
 
-			sym -= 257;
+	munmap(ring, 2 * size);
+}
+#endif
 
-			/* Possibly get more bits from length code */
-			length = tinf_getbits_base(d, length_bits[sym],
-			                           length_base[sym]);
+/* Decompress to write through the window d was started with */
+static long tinf_write_through(struct tinf_data *d,
+                               tinf_write_callback write, void *opaque,
+                               unsigned long skip, unsigned long *destLen,
+                               const void *source, unsigned long sourceLen)
+{
+	d->source = (const unsigned char *) source;
+	d->source_start = d->source;
+	d->source_end = d->source + sourceLen;
+	d->write = write;
+	d->write_opaque = opaque;
+	d->skip = skip;
 
-			dist = tinf_decode_symbol(d, dt);
+	TINF_PROBE4(stream_start, source, sourceLen, NULL, 0);
 
-			/* Check dist is within range */
-			if (dist > dt->max_sym || dist > 29) {
-				return TINF_DATA_ERROR;
-			}
+	return tinf_finish(d, destLen);
+}
 
-			/* Possibly get more bits from distance code */
-			offs = tinf_getbits_base(d, dist_bits[dist],
-			                         dist_base[dist]);
+/*
+ * Decompress to write through a window on the stack. Not inlined, so the
+ * window is only on the stack when it is used.
+ */
+static TINF_NOINLINE long
+tinf_write_stack(tinf_write_callback write, void *opaque,
+                 unsigned long skip, unsigned long *destLen,
+                 const void *source, unsigned long sourceLen)
+{
+	unsigned char window[TINF_WRITE_BUF_SIZE];
+	struct tinf_data d;
 
-			if (offs > d->dest - d->dest_start) {
-				return TINF_DATA_ERROR;
-			}
+	tinf_start(&d, window, TINF_WRITE_BUF_SIZE);
 
-			if (d->dest_end - d->dest < length) {
-				return TINF_BUF_ERROR;
-			}
+	return tinf_write_through(&d, write, opaque, skip, destLen,
+	                          source, sourceLen);
+}
 
-			/* Copy match */
-			for (i = 0; i < length; ++i) {
-				d->dest[i] = d->dest[i - offs];
-			}
+long tinf_inflate_write(tinf_write_callback write, void *opaque,
+                        unsigned long skip, unsigned long *destLen,
+                        const void *source, unsigned long sourceLen)
+{
+#ifdef TINF_RING
+	unsigned long ring_size = tinf_ring_size();
+	unsigned char *ring = tinf_ring_get(ring_size);
 
-			d->dest += length;
-		}
+	/* Use the window on the stack if the ring cannot be mapped */
+	if (ring != NULL) {
+		struct tinf_data d;
+		long res;
+
+		tinf_start(&d, ring, ring_size);
+		d.ring_size = ring_size;
+
+		res = tinf_write_through(&d, write, opaque, skip, destLen,
+		                         source, sourceLen);
+
+		tinf_ring_put(ring, ring_size);
+
+		return res;
 	}
+#endif
+
+	return tinf_write_stack(write, opaque, skip, destLen,
+	                        source, sourceLen);
 }
 
-/* Inflate an uncompressed block of data */
-static long tinf_inflate_uncompressed_block(struct tinf_data *d)
+long tinf_uncompress_write(tinf_write_callback write, void *opaque,
+                           unsigned long *destLen,
+                           const void *source, unsigned long sourceLen)
 {
-	unsigned long length, invlength;
+	long res = tinf_inflate_write(write, opaque, 0, destLen,
+	                              source, sourceLen);
 
-	if (d->source_end - d->source < 4) {
-		return TINF_DATA_ERROR;
-	}
+	TINF_COUNT_CALL(TINF_API_UNCOMPRESS_WRITE, sourceLen,
+	                res == TINF_OK ? *destLen : 0, res);
 
-	/* Get length */
-	length = read_le16(d->source);
+	return res;
+}
 
-	/* Get one's complement of length */
-	invlength = read_le16(d->source + 2);
+long tinf_inflate_window(tinf_write_callback write, void *opaque,
+                         void *window, unsigned long windowLen,
+                         unsigned long windowBits, unsigned long *destLen,
+                         const void *source, unsigned long sourceLen)
+{
+	struct tinf_data d;
 
-	/* Check length */
-	if (length != (~invlength & 0x0000FFFF)) {
-		return TINF_DATA_ERROR;
+	/* Room for the window and the longest match */
+	if (windowBits < 8 || windowBits > 15
+	 || windowLen < (1UL << windowBits) + 1024) {
+		return TINF_BUF_ERROR;
 	}
 
-	d->source += 4;
+	tinf_start(&d, window, windowLen);
 
-	if (d->source_end - d->source < length) {
-		return TINF_DATA_ERROR;
-	}
+	d.source = (const unsigned char *) source;
+	d.source_start = d.source;
+	d.source_end = d.source + sourceLen;
+	d.write = write;
+	d.write_opaque = opaque;
+	d.window = 1UL << windowBits;
 
-	if (d->dest_end - d->dest < length) {
-		return TINF_BUF_ERROR;
-	}
+	TINF_PROBE4(stream_start, source, sourceLen, NULL, 0);
 
-	/* Copy block */
-	while (length--) {
-		*d->dest++ = *d->source++;
-	}
+	return tinf_finish(&d, destLen);
+}
 
-	/* Make sure we start next block on a byte boundary */
-	d->tag = 0;
-	d->bitcount = 0;
+long tinf_uncompress_window(tinf_write_callback write, void *opaque,
+                            void *window, unsigned long windowLen,
+                            unsigned long windowBits, unsigned long *destLen,
+                            const void *source, unsigned long sourceLen)
+{
+	long res = tinf_inflate_window(write, opaque, window, windowLen,
+	                               windowBits, destLen, source, sourceLen);
 
-	return TINF_OK;
+	TINF_COUNT_CALL(TINF_API_UNCOMPRESS_WINDOW, sourceLen,
+	                res == TINF_OK ? *destLen : 0, res);
+
+	return res;
 }
 
-/* Inflate a block of data compressed with fixed Huffman trees */
-static long tinf_inflate_fixed_block(struct tinf_data *d)
+long tinf_uncompress_skip(tinf_write_callback write, void *opaque,
+                          unsigned long skip, unsigned long *destLen,
+                          const void *source, unsigned long sourceLen)
 {
-	/* Build fixed Huffman trees */
-	tinf_build_fixed_trees(&d->ltree, &d->dtree);
+	long res = tinf_inflate_write(write, opaque, skip, destLen,
+	                              source, sourceLen);
 
-	/* Decode block using fixed trees */
-	return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
+	TINF_COUNT_CALL(TINF_API_UNCOMPRESS_SKIP, sourceLen,
+	                res == TINF_OK ? *destLen : 0, res);
+
+	return res;
 }
 
-/* Inflate a block of data compressed with dynamic Huffman trees */
-static long tinf_inflate_dynamic_block(struct tinf_data *d)
+long tinf_uncompress2(void *dest, unsigned long *destLen,
+                      const void *source, unsigned long *sourceLen,
+                      unsigned long *endBit)
 {
-	/* Decode trees from stream */
-	long res = tinf_decode_trees(d, &d->ltree, &d->dtree);
+	unsigned long bits = 0;
+	long res = tinf_inflate_bits(dest, destLen, source, *sourceLen, &bits);
 
-	if (res != TINF_OK) {
-		return res;
+	TINF_COUNT_CALL(TINF_API_UNCOMPRESS2, *sourceLen, *destLen, res);
+
+	if (res == TINF_OK) {
+		*sourceLen = (bits + 7) / 8;
+
+		if (endBit != NULL) {
+			*endBit = bits;
+		}
 	}
 
-	/* Decode block using decoded trees */
-	return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
+	return res;
 }
 
-/* -- Public functions -- */
-
-/* Initialize global (static) data */
-void tinf_init(void)
+long tinf_uncompress_prefix(void *dest, unsigned long *destLen,
+                            const void *source, unsigned long *sourceLen)
 {
-	return;
+	struct tinf_data d;
+	long res;
+
+	tinf_start(&d, dest, *destLen);
+
+	d.source = (const unsigned char *) source;
+	d.source_start = d.source;
+	d.source_end = d.source + *sourceLen;
+	d.prefix = 1;
+
+	TINF_PROBE4(stream_start, source, *sourceLen, dest, *destLen);
+
+	res = tinf_finish(&d, destLen);
+
+	TINF_COUNT_CALL(TINF_API_UNCOMPRESS_PREFIX, *sourceLen, *destLen, res);
+
+	if (res == TINF_OK || res == TINF_OUTPUT_FULL) {
+		unsigned long used = (tinf_bit_offset(&d) + 7) / 8;
+
+		/* Bits of the zero padding past the input are not counted */
+		if (used < *sourceLen) {
+			*sourceLen = used;
+		}
+	}
+
+	return res;
 }
 
-/* Inflate stream from source to dest */
-long tinf_uncompress(void *dest, unsigned long *destLen,
-                    const void *source, unsigned long sourceLen)
+long tinf_uncompress_iov(const struct tinf_iovec *iov, unsigned long iovcnt,
+                         unsigned long *destLen,
+                         const void *source, unsigned long sourceLen)
 {
 	struct tinf_data d;
-	long bfinal;
+	long res;
+
+	if (iovcnt > 0) {
+		tinf_start(&d, iov[0].iov_base, iov[0].iov_len);
+	}
+	else {
+		tinf_start(&d, NULL, 0);
+	}
 
-	/* Initialise data */
 	d.source = (const unsigned char *) source;
+	d.source_start = d.source;
 	d.source_end = d.source + sourceLen;
-	d.tag = 0;
-	d.bitcount = 0;
-	d.overflow = 0;
+	d.iov = iov;
+	d.iov_count = iovcnt;
 
-	d.dest = (unsigned char *) dest;
-	d.dest_start = d.dest;
-	d.dest_end = d.dest + *destLen;
+	TINF_PROBE4(stream_start, source, sourceLen, NULL, 0);
 
-	do {
-		unsigned long btype;
-		long res;
+	res = tinf_finish(&d, destLen);
 
-		/* Read final block flag */
-		bfinal = tinf_getbits(&d, 1);
+	TINF_COUNT_CALL(TINF_API_UNCOMPRESS_IOV, sourceLen,
+	                res == TINF_OK ? *destLen : 0, res);
 
-		/* Read block type (2 bits) */
-		btype = tinf_getbits(&d, 2);
+	return res;
+}
 
-		/* Decompress block */
-		switch (btype) {
-		case 0:
-			/* Decompress uncompressed block */
-			res = tinf_inflate_uncompressed_block(&d);
-			break;
-		case 1:
-			/* Decompress block with fixed Huffman trees */
-			res = tinf_inflate_fixed_block(&d);
-			break;
-		case 2:
-			/* Decompress block with dynamic Huffman trees */
-			res = tinf_inflate_dynamic_block(&d);
-			break;
-		default:
-			res = TINF_DATA_ERROR;
-			break;
-		}
+/* Default grow callback */
+static void *TINFCC tinf_realloc(void *ptr, unsigned long size, void *opaque)
+{
+	(void) opaque;
 
-		if (res != TINF_OK) {
-			return res;
+	return realloc(ptr, size);
+}
+
+long tinf_inflate_alloc(void **dest, unsigned long *destLen,
+                        const void *source, unsigned long sourceLen,
+                        tinf_grow_callback grow, void *opaque)
+{
+	struct tinf_data d;
+	long res;
+
+	if (grow == NULL) {
+		grow = tinf_realloc;
+	}
+
+	/* Allocate the first buffer, using destLen as a size hint */
+	if (*dest == NULL) {
+		if (*destLen == 0) {
+			*destLen = TINF_GROW_MIN;
 		}
-	} while (!bfinal);
 
-	/* Check for overflow in bit reader */
-	if (d.overflow) {
-		return TINF_DATA_ERROR;
+		*dest = grow(NULL, *destLen, opaque);
+
+		if (*dest == NULL) {
+			return TINF_BUF_ERROR;
+		}
 	}
 
-	*destLen = d.dest - d.dest_start;
+	tinf_start(&d, *dest, *destLen);
 
-	return TINF_OK;
+	d.source = (const unsigned char *) source;
+	d.source_start = d.source;
+	d.source_end = d.source + sourceLen;
+	d.grow = grow;
+	d.grow_opaque = opaque;
+
+	TINF_PROBE4(stream_start, source, sourceLen, *dest, *destLen);
+
+	res = tinf_finish(&d, destLen);
+
+	/* The buffer may have moved, even on error */
+	*dest = d.dest_start;
+
+	return res;
 }
 
-/* clang -g -O1 -fsanitize=fuzzer,address -DTINF_FUZZING tinflate.c */
+long tinf_uncompress_alloc(void **dest, unsigned long *destLen,
+                           const void *source, unsigned long sourceLen,
+                           tinf_grow_callback grow, void *opaque)
+{
+	long res = tinf_inflate_alloc(dest, destLen, source, sourceLen,
+	                              grow, opaque);
+
+	TINF_COUNT_CALL(TINF_API_UNCOMPRESS_ALLOC, sourceLen, *destLen, res);
+
+	return res;
+}
+
+/*
+ * Built by CMake with -DTINF_BUILD_FUZZER=ON, or with:
+ *
+ *   clang -g -O1 -fsanitize=fuzzer,address -DTINF_FUZZING tinflate.c \
+ *         tinfcpu.c tinfstat.c adler32.c crc32.c
+ *
+ * If the environment variable TINF_FUZZ_MAX_NS_PER_BYTE is set, inputs that
+ * take longer than that many nanoseconds per input byte (plus 1 ms) to
+ * decompress abort, so libFuzzer saves slow units like crashes.
+ */
 #if defined(TINF_FUZZING)
 #include <limits.h>
 #include <stddef.h>
-#include <stdlong.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 unsigned char depacked[64 * 1024];
 
-extern long
-LLVMFuzzerTestOneInput(const ulong8_t *data, size_t size)
+static long long fuzz_ns(void)
 {
-	if (size > UINT_MAX / 2) { return 0; }
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static long long max_ns_per_byte = -2;
 	unsigned long destLen = sizeof(depacked);
+	long long start, elapsed;
+
+	if (size > UINT_MAX / 2) { return 0; }
+
+	if (max_ns_per_byte == -2) {
+		const char *s = getenv("TINF_FUZZ_MAX_NS_PER_BYTE");
+
+		max_ns_per_byte = s ? atoll(s) : -1;
+	}
+
+	start = fuzz_ns();
 	tinf_uncompress(depacked, &destLen, data, size);
+	elapsed = fuzz_ns() - start;
+
+	if (max_ns_per_byte >= 0
+	 && elapsed > 1000000 + max_ns_per_byte * (long long) size) {
+		fprintf(stderr, "tinf: slow unit, %lld ns for %lu bytes\n",
+		        elapsed, (unsigned long) size);
+		abort();
+	}
+
 	return 0;
 }
 #endif
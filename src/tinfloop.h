@@ -0,0 +1,191 @@
+/*
+ * tinfloop - tinf table driven decode loop
+ *
+ * Copyright (c) 2026 tinf contributors
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *   1. The origin of this software must not be misrepresented; you must
+ *      not claim that you wrote the original software. If you use this
+ *      software in a product, an acknowledgment in the product
+ *      documentation would be appreciated but is not required.
+ *
+ *   2. Altered source versions must be plainly marked as such, and must
+ *      not be misrepresented as being the original software.
+ *
+ *   3. This notice may not be removed or altered from any source
+ *      distribution.
+ */
+
+/*
+ * This file is included by tinflate.c once for each instruction set
+ * variant of the decode loop, with these macros defined:
+ *
+ *   TINF_LOOP_NAME   - name of the function
+ *   TINF_LOOP_ATTR   - function attributes, like a target
+ *   TINF_LOOP_COPY   - statement copying a match, given dest, offs and
+ *                      length
+ *
+ * The loop body is compiled twice, once for codes that need sub-tables and
+ * once for codes that all fit in the root tables, where the sub-table check
+ * is left out.
+ */
+
+#ifndef TINF_CAT
+#  define TINF_CAT_(a, b) a##b
+#  define TINF_CAT(a, b) TINF_CAT_(a, b)
+#endif
+
+#define TINF_LOOP_BODY TINF_CAT(TINF_LOOP_NAME, _body)
+
+/*
+ * Given a stream and tables, inflate a block of data. If single is
+ * non-zero, all codes must fit in the root tables. Returns TINF_FULL with
+ * the symbol in pending_length and pending_offs if there is no room for it,
+ * or if a match reaches back past dest_start.
+ */
+static TINF_LOOP_ATTR TINF_ALWAYS_INLINE long
+TINF_LOOP_BODY(struct tinf_data *d, const struct tinf_codes *c, long single)
+{
+	struct tinf_entry e;
+
+	/*
+	 * The root entry of each literal/length code is looked up as soon as
+	 * the previous symbol is decoded. For matches this is before the copy,
+	 * so the table load overlaps with copying.
+	 */
+	tinf_refill(d, 15 + 5);
+
+	e = tinf_peek_entry(d, c->ltable, TINF_LTABLE_BITS);
+
+	for (;;) {
+		if (!single) {
+			e = tinf_resolve_entry(d, c->ltable, e, TINF_LTABLE_BITS);
+		}
+
+		/* Only take the first literal of a pair if there is no room */
+		if ((e.op & 0xF0) == TINF_OP_LIT2 && d->dest_end - d->dest < 2) {
+			e.bits = e.op & 0x0F;
+			e.op = TINF_OP_LIT;
+			e.value &= 0xFF;
+		}
+
+		tinf_getbits_no_refill(d, e.bits);
+
+		/* Check for overflow in bit reader */
+		if (tinf_overrun(d)) {
+			return TINF_DATA_ERROR;
+		}
+
+		switch (e.op & 0xF0) {
+		case TINF_OP_LIT:
+			if (d->dest == d->dest_end) {
+				d->pending_length = e.value;
+				d->pending_offs = 0;
+				goto full;
+			}
+			*d->dest++ = e.value;
+
+			TINF_STAT(d->stats.literals++);
+			break;
+		case TINF_OP_LIT2:
+			d->dest[0] = e.value & 0xFF;
+			d->dest[1] = e.value >> 8;
+			d->dest += 2;
+
+			TINF_STAT(d->stats.literals += 2);
+			break;
+		case TINF_OP_EOB:
+			return TINF_OK;
+		case TINF_OP_LEN: {
+			long length, offs;
+
+			/* Get length extra bits, if not included in the entry */
+			length = e.value + tinf_getbits_no_refill(d, e.op & 0x0F);
+
+			tinf_refill(d, 15);
+
+			e = single ? tinf_peek_entry(d, c->dtable, TINF_DTABLE_BITS)
+			           : tinf_decode_entry(d, c->dtable, TINF_DTABLE_BITS);
+
+			/* Check distance symbol is valid */
+			if ((e.op & 0xF0) != TINF_OP_DIST) {
+				return TINF_DATA_ERROR;
+			}
+
+			tinf_getbits_no_refill(d, e.bits);
+
+			/* Get distance extra bits, if not included in the entry */
+			offs = e.value + tinf_getbits(d, e.op & 0x0F);
+
+			/*
+			 * Distances past dest_start or the window are checked
+			 * by the caller
+			 */
+			if (offs > d->dest - d->dest_start
+			 || (unsigned long) offs > d->window) {
+				d->pending_length = length;
+				d->pending_offs = offs;
+				goto full;
+			}
+
+#ifdef TINF_PREFETCH_DIST
+			/* Start loading the source of far matches early */
+			if (offs > TINF_PREFETCH_DIST) {
+				TINF_PREFETCH(d->dest - offs);
+			}
+#endif
+
+			if (d->dest_end - d->dest < length) {
+				d->pending_length = length;
+				d->pending_offs = offs;
+				goto full;
+			}
+
+			TINF_STAT(tinf_stats_match(d, length, offs));
+
+			/* Enough for the next code and length extra bits */
+			tinf_refill(d, 15 + 5);
+
+			e = tinf_peek_entry(d, c->ltable, TINF_LTABLE_BITS);
+
+			TINF_LOOP_COPY(d->dest, offs, length);
+
+			d->dest += length;
+			continue;
+		}
+		default:
+			return TINF_DATA_ERROR;
+		}
+
+		/* Enough for the next code and length extra bits */
+		tinf_refill(d, 15 + 5);
+
+		e = tinf_peek_entry(d, c->ltable, TINF_LTABLE_BITS);
+	}
+
+full:
+	return TINF_FULL;
+}
+
+/* Given a stream and tables, inflate a block of data */
+static TINF_LOOP_ATTR long
+TINF_LOOP_NAME(struct tinf_data *d, const struct tinf_codes *c)
+{
+	if (c->single) {
+		return TINF_LOOP_BODY(d, c, 1);
+	}
+
+	return TINF_LOOP_BODY(d, c, 0);
+}
+
+#undef TINF_LOOP_BODY
+#undef TINF_LOOP_NAME
+#undef TINF_LOOP_ATTR
+#undef TINF_LOOP_COPY
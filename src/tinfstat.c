@@ -0,0 +1,422 @@
+/*
+ * tinfstat - tinf statistics, counters and tracing
+ *
+ * Copyright (c) 2026 tinf contributors
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *   1. The origin of this software must not be misrepresented; you must
+ *      not claim that you wrote the original software. If you use this
+ *      software in a product, an acknowledgment in the product
+ *      documentation would be appreciated but is not required.
+ *
+ *   2. Altered source versions must be plainly marked as such, and must
+ *      not be misrepresented as being the original software.
+ *
+ *   3. This notice may not be removed or altered from any source
+ *      distribution.
+ */
+
+#if !defined(_POSIX_C_SOURCE) && !defined(_WIN32)
+#  define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "tinfint.h"
+
+#if defined(TINF_BLOCK_STATS) || defined(TINF_COUNTERS)
+
+#include <time.h>
+
+unsigned long tinf_clock_ns(void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long) ts.tv_sec * 1000000000UL
+	     + (unsigned long) ts.tv_nsec;
+#else
+	return (unsigned long) ((double) clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
+
+#endif
+
+#ifdef TINF_COUNTERS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(TINF_NO_THREADS)
+#  include <pthread.h>
+#  define TINF_PTHREADS 1
+#endif
+
+/*
+ * Each thread gets its own counters on first use, so counting needs no
+ * locks or atomic additions. The counters of all live threads are kept in a list,
+ * and when a thread exits its counters are added to tinf_retired.
+ *
+ * Without POSIX threads, all calls update the same counters.
+ */
+struct tinf_counter_block {
+	struct tinf_counters c;
+	struct tinf_counter_block *next;
+};
+
+static struct tinf_counter_block tinf_shared_block;
+
+#ifdef TINF_PTHREADS
+static pthread_mutex_t tinf_counters_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t tinf_counters_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tinf_counters_key;
+static struct tinf_counter_block *tinf_blocks = NULL;
+static struct tinf_counters tinf_retired;
+#endif
+
+/*
+ * Other threads read the counters of a thread while it adds to them. Only
+ * the owner writes them, so a relaxed atomic load and store is enough for
+ * readers never to see a torn count. Without 64-bit atomics, counts read
+ * from other threads may be off while they are being updated.
+ */
+#if defined(__ATOMIC_RELAXED) && __GCC_ATOMIC_LLONG_LOCK_FREE == 2
+#  define TINF_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#  define TINF_ADD(x, n) \
+	__atomic_store_n(&(x), TINF_LOAD(x) + (n), __ATOMIC_RELAXED)
+#else
+#  define TINF_LOAD(x) (x)
+#  define TINF_ADD(x, n) ((x) += (n))
+#endif
+
+static void tinf_add_counters(struct tinf_counters *dst,
+                              const struct tinf_counters *src)
+{
+	long i;
+
+	for (i = 0; i < TINF_API_COUNT; ++i) {
+		dst->calls[i] += TINF_LOAD(src->calls[i]);
+		dst->bytes_in[i] += TINF_LOAD(src->bytes_in[i]);
+		dst->bytes_out[i] += TINF_LOAD(src->bytes_out[i]);
+		dst->data_errors[i] += TINF_LOAD(src->data_errors[i]);
+		dst->buf_errors[i] += TINF_LOAD(src->buf_errors[i]);
+	}
+
+	for (i = 0; i < 3; ++i) {
+		dst->blocks[i] += TINF_LOAD(src->blocks[i]);
+	}
+
+	for (i = 0; i < TINF_CHECKSUM_COUNT; ++i) {
+		dst->checksum_bytes[i] += TINF_LOAD(src->checksum_bytes[i]);
+		dst->checksum_ns[i] += TINF_LOAD(src->checksum_ns[i]);
+	}
+}
+
+#ifdef TINF_PTHREADS
+/* Called on thread exit, keep the counts and free the block */
+static void tinf_retire_block(void *p)
+{
+	struct tinf_counter_block *b = (struct tinf_counter_block *) p;
+	struct tinf_counter_block **pp;
+
+	pthread_mutex_lock(&tinf_counters_lock);
+
+	tinf_add_counters(&tinf_retired, &b->c);
+
+	for (pp = &tinf_blocks; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == b) {
+			*pp = b->next;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&tinf_counters_lock);
+
+	free(b);
+}
+
+static void tinf_counters_init(void)
+{
+	pthread_key_create(&tinf_counters_key, tinf_retire_block);
+}
+#endif
+
+/* Get counters of the calling thread */
+static struct tinf_counters *tinf_local_counters(void)
+{
+#ifdef TINF_PTHREADS
+	struct tinf_counter_block *b;
+
+	pthread_once(&tinf_counters_once, tinf_counters_init);
+
+	b = (struct tinf_counter_block *) pthread_getspecific(tinf_counters_key);
+
+	if (b == NULL) {
+		b = (struct tinf_counter_block *) calloc(1, sizeof(*b));
+
+		/* If out of memory, fall back on the shared counters */
+		if (b == NULL) {
+			return &tinf_shared_block.c;
+		}
+
+		pthread_mutex_lock(&tinf_counters_lock);
+		b->next = tinf_blocks;
+		tinf_blocks = b;
+		pthread_mutex_unlock(&tinf_counters_lock);
+
+		pthread_setspecific(tinf_counters_key, b);
+	}
+
+	return &b->c;
+#else
+	return &tinf_shared_block.c;
+#endif
+}
+
+void tinf_count_call(long api, unsigned long in, unsigned long out, long res)
+{
+	struct tinf_counters *c = tinf_local_counters();
+
+	TINF_ADD(c->calls[api], 1);
+	TINF_ADD(c->bytes_in[api], in);
+
+	if (res == TINF_OK || res == TINF_OUTPUT_FULL) {
+		TINF_ADD(c->bytes_out[api], out);
+	}
+	else if (res == TINF_BUF_ERROR) {
+		TINF_ADD(c->buf_errors[api], 1);
+	}
+	else {
+		TINF_ADD(c->data_errors[api], 1);
+	}
+}
+
+void tinf_count_block(long btype)
+{
+	if (btype >= 0 && btype < 3) {
+		struct tinf_counters *c = tinf_local_counters();
+
+		TINF_ADD(c->blocks[btype], 1);
+	}
+}
+
+void tinf_get_counters(struct tinf_counters *c)
+{
+	memset(c, 0, sizeof(*c));
+
+#ifdef TINF_PTHREADS
+	{
+		const struct tinf_counter_block *b;
+
+		pthread_mutex_lock(&tinf_counters_lock);
+
+		tinf_add_counters(c, &tinf_retired);
+
+		for (b = tinf_blocks; b != NULL; b = b->next) {
+			tinf_add_counters(c, &b->c);
+		}
+
+		pthread_mutex_unlock(&tinf_counters_lock);
+	}
+#endif
+
+	tinf_add_counters(c, &tinf_shared_block.c);
+}
+
+/* -- Prometheus text format -- */
+
+struct tinf_text {
+	char *buf;
+	unsigned long size;
+	unsigned long len;
+};
+
+static void tinf_text_add(struct tinf_text *t, const char *s)
+{
+	for (; *s; ++s, ++t->len) {
+		if (t->len + 1 < t->size) {
+			t->buf[t->len] = *s;
+		}
+	}
+}
+
+static void tinf_text_metric(struct tinf_text *t, const char *name,
+                             const char *help)
+{
+	tinf_text_add(t, "# HELP ");
+	tinf_text_add(t, name);
+	tinf_text_add(t, " ");
+	tinf_text_add(t, help);
+	tinf_text_add(t, "\n# TYPE ");
+	tinf_text_add(t, name);
+	tinf_text_add(t, " counter\n");
+}
+
+static void tinf_text_sample(struct tinf_text *t, const char *name,
+                             const char *labels, unsigned long long value)
+{
+	char num[32];
+
+	sprintf(num, " %llu\n", value);
+
+	tinf_text_add(t, name);
+	tinf_text_add(t, "{");
+	tinf_text_add(t, labels);
+	tinf_text_add(t, "}");
+	tinf_text_add(t, num);
+}
+
+unsigned long tinf_format_counters(char *buf, unsigned long size)
+{
+	static const char *const api_labels[TINF_API_COUNT] = {
+		"api=\"uncompress\"", "api=\"zlib_uncompress\"",
+		"api=\"gzip_uncompress\"", "api=\"uncompress_read\"",
+		"api=\"uncompress_write\"", "api=\"uncompress_alloc\"",
+		"api=\"zlib_uncompress_alloc\"", "api=\"uncompress_prefix\"",
+		"api=\"uncompress2\"", "api=\"zlib_uncompress2\"",
+		"api=\"gzip_uncompress2\"", "api=\"uncompress_iov\"",
+		"api=\"zlib_verify\"", "api=\"gzip_verify\"",
+		"api=\"uncompress_skip\"", "api=\"uncompress_window\"",
+		"api=\"zlib_uncompress_window\""
+	};
+	static const char *const block_labels[3] = {
+		"type=\"stored\"", "type=\"fixed\"", "type=\"dynamic\""
+	};
+	static const char *const checksum_labels[TINF_CHECKSUM_COUNT] = {
+		"algorithm=\"crc32\"", "algorithm=\"adler32\""
+	};
+
+	struct tinf_counters c;
+	struct tinf_text t;
+	char labels[64];
+	long i;
+
+	tinf_get_counters(&c);
+
+	t.buf = buf;
+	t.size = size;
+	t.len = 0;
+
+	tinf_text_metric(&t, "tinf_calls_total",
+	                 "Number of calls to decompression functions.");
+	for (i = 0; i < TINF_API_COUNT; ++i) {
+		tinf_text_sample(&t, "tinf_calls_total", api_labels[i], c.calls[i]);
+	}
+
+	tinf_text_metric(&t, "tinf_errors_total",
+	                 "Number of calls that failed, by error code.");
+	for (i = 0; i < TINF_API_COUNT; ++i) {
+		sprintf(labels, "%s,code=\"data_error\"", api_labels[i]);
+		tinf_text_sample(&t, "tinf_errors_total", labels, c.data_errors[i]);
+		sprintf(labels, "%s,code=\"buf_error\"", api_labels[i]);
+		tinf_text_sample(&t, "tinf_errors_total", labels, c.buf_errors[i]);
+	}
+
+	tinf_text_metric(&t, "tinf_input_bytes_total",
+	                 "Number of source bytes passed to decompression functions.");
+	for (i = 0; i < TINF_API_COUNT; ++i) {
+		tinf_text_sample(&t, "tinf_input_bytes_total", api_labels[i],
+		                 c.bytes_in[i]);
+	}
+
+	tinf_text_metric(&t, "tinf_output_bytes_total",
+	                 "Number of bytes decompressed successfully.");
+	for (i = 0; i < TINF_API_COUNT; ++i) {
+		tinf_text_sample(&t, "tinf_output_bytes_total", api_labels[i],
+		                 c.bytes_out[i]);
+	}
+
+	tinf_text_metric(&t, "tinf_blocks_total",
+	                 "Number of deflate blocks decoded, by type.");
+	for (i = 0; i < 3; ++i) {
+		tinf_text_sample(&t, "tinf_blocks_total", block_labels[i],
+		                 c.blocks[i]);
+	}
+
+	tinf_text_metric(&t, "tinf_checksum_bytes_total",
+	                 "Number of bytes checksummed.");
+	for (i = 0; i < TINF_CHECKSUM_COUNT; ++i) {
+		tinf_text_sample(&t, "tinf_checksum_bytes_total",
+		                 checksum_labels[i], c.checksum_bytes[i]);
+	}
+
+	tinf_text_metric(&t, "tinf_checksum_seconds_total",
+	                 "Time spent computing checksums.");
+	for (i = 0; i < TINF_CHECKSUM_COUNT; ++i) {
+		char num[48];
+
+		sprintf(num, " %llu.%09llu\n", c.checksum_ns[i] / 1000000000,
+		        c.checksum_ns[i] % 1000000000);
+
+		tinf_text_add(&t, "tinf_checksum_seconds_total{");
+		tinf_text_add(&t, checksum_labels[i]);
+		tinf_text_add(&t, "}");
+		tinf_text_add(&t, num);
+	}
+
+	if (size > 0) {
+		buf[t.len < size ? t.len : size - 1] = '\0';
+	}
+
+	return t.len;
+}
+
+#endif /* TINF_COUNTERS */
+
+#if defined(TINF_COUNTERS) || defined(TINF_USDT)
+
+/* -- Counted and traced checksums -- */
+
+unsigned long tinf_traced_crc32(unsigned long crc, const void *data,
+                                unsigned long length)
+{
+#ifdef TINF_COUNTERS
+	struct tinf_counters *c = tinf_local_counters();
+	unsigned long start = tinf_clock_ns();
+#endif
+
+	TINF_PROBE2(checksum_start, "crc32", length);
+
+	crc = tinf_crc32_update(crc, data, length);
+
+	TINF_PROBE2(checksum_end, "crc32", crc);
+
+#ifdef TINF_COUNTERS
+	TINF_ADD(c->checksum_ns[TINF_CHECKSUM_CRC32], tinf_clock_ns() - start);
+	TINF_ADD(c->checksum_bytes[TINF_CHECKSUM_CRC32], length);
+#endif
+
+	return crc;
+}
+
+unsigned long tinf_traced_adler32(unsigned long a32, const void *data,
+                                  unsigned long length)
+{
+#ifdef TINF_COUNTERS
+	struct tinf_counters *c = tinf_local_counters();
+	unsigned long start = tinf_clock_ns();
+#endif
+
+	TINF_PROBE2(checksum_start, "adler32", length);
+
+	a32 = tinf_adler32_update(a32, data, length);
+
+	TINF_PROBE2(checksum_end, "adler32", a32);
+
+#ifdef TINF_COUNTERS
+	TINF_ADD(c->checksum_ns[TINF_CHECKSUM_ADLER32], tinf_clock_ns() - start);
+	TINF_ADD(c->checksum_bytes[TINF_CHECKSUM_ADLER32], length);
+#endif
+
+	return a32;
+}
+
+#endif
@@ -23,7 +23,9 @@
  *      distribution.
  */
 
-#include "tinf.h"
+#include "tinfint.h"
+
+#include <stddef.h>
 
 static unsigned long read_be32(const unsigned char *p)
 {
@@ -33,17 +35,12 @@ static unsigned long read_be32(const unsigned char *p)
 	     | ((unsigned long) p[3]);
 }
 
-long tinf_zlib_uncompress(void *dest, unsigned long *destLen,
-                         const void *source, unsigned long sourceLen)
+/* Check zlib header and room for trailer */
+static long tinf_zlib_check_header(const unsigned char *src,
+                                   unsigned long sourceLen)
 {
-	const unsigned char *src = (const unsigned char *) source;
-	unsigned char *dst = (unsigned char *) dest;
-	unsigned long a32;
-	long res;
 	unsigned char cmf, flg;
 
-	/* -- Check header -- */
-
 	/* Check room for at least 2 byte header and 4 byte trailer */
 	if (sourceLen < 6) {
 		return TINF_DATA_ERROR;
@@ -73,23 +70,285 @@ long tinf_zlib_uncompress(void *dest, unsigned long *destLen,
 		return TINF_DATA_ERROR;
 	}
 
+	return TINF_OK;
+}
+
+static long tinf_zlib_inflate(void *dest, unsigned long *destLen,
+                              const void *source, unsigned long sourceLen)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	unsigned char *dst = (unsigned char *) dest;
+	unsigned long a32;
+	long res;
+
+	/* -- Check header -- */
+
+	if (tinf_zlib_check_header(src, sourceLen) != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
 	/* -- Get Adler-32 checksum of original data -- */
 
 	a32 = read_be32(&src[sourceLen - 4]);
 
 	/* -- Decompress data -- */
 
-	res = tinf_uncompress(dst, destLen, src + 2, sourceLen - 6);
+	res = tinf_inflate(dst, destLen, src + 2, sourceLen - 6);
+
+	if (res != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Check Adler-32 checksum -- */
+
+	if (a32 != TINF_ADLER32(dst, *destLen)) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+static long tinf_zlib_inflate2(void *dest, unsigned long *destLen,
+                               const void *source, unsigned long *sourceLen,
+                               unsigned long *endBit)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	unsigned long bits = 0;
+	unsigned long used;
+	long res;
+
+	/* -- Check header -- */
+
+	if (tinf_zlib_check_header(src, *sourceLen) != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Decompress data -- */
+
+	res = tinf_inflate_bits(dest, destLen, src + 2, *sourceLen - 2, &bits);
 
 	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Check Adler-32 checksum, which follows the deflate data -- */
+
+	used = 2 + (bits + 7) / 8;
+
+	if (*sourceLen - used < 4) {
+		return TINF_DATA_ERROR;
+	}
+
+	if (read_be32(&src[used]) != TINF_ADLER32(dest, *destLen)) {
+		return TINF_DATA_ERROR;
+	}
+
+	*sourceLen = used + 4;
+
+	if (endBit != NULL) {
+		*endBit = 16 + bits;
+	}
+
+	return TINF_OK;
+}
+
+static long tinf_zlib_inflate_alloc(void **dest, unsigned long *destLen,
+                                    const void *source,
+                                    unsigned long sourceLen,
+                                    tinf_grow_callback grow, void *opaque)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	unsigned long a32;
+	long res;
+
+	/* -- Check header -- */
+
+	if (tinf_zlib_check_header(src, sourceLen) != TINF_OK) {
 		return TINF_DATA_ERROR;
 	}
 
+	/* -- Get Adler-32 checksum of original data -- */
+
+	a32 = read_be32(&src[sourceLen - 4]);
+
+	/* -- Decompress data -- */
+
+	res = tinf_inflate_alloc(dest, destLen, src + 2, sourceLen - 6,
+	                         grow, opaque);
+
+	/* Keep TINF_BUF_ERROR, which means the buffer could not be grown */
+	if (res != TINF_OK) {
+		return res;
+	}
+
 	/* -- Check Adler-32 checksum -- */
 
-	if (a32 != tinf_adler32(dst, *destLen)) {
+	if (a32 != TINF_ADLER32(*dest, *destLen)) {
 		return TINF_DATA_ERROR;
 	}
 
 	return TINF_OK;
 }
+
+/* Write callback that only updates the Adler-32 checksum in opaque */
+static long TINFCC tinf_zlib_check_write(const void *buf, unsigned long size,
+                                         void *opaque)
+{
+	unsigned long *a32 = (unsigned long *) opaque;
+
+	*a32 = TINF_ADLER32_UPDATE(*a32, buf, size);
+
+	return 0;
+}
+
+static long tinf_zlib_inflate_verify(unsigned long *destLen,
+                                     const void *source,
+                                     unsigned long sourceLen)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	unsigned long a32 = 1;
+	long res;
+
+	/* -- Check header -- */
+
+	if (tinf_zlib_check_header(src, sourceLen) != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Decompress data, computing the checksum as it is written -- */
+
+	res = tinf_inflate_write(tinf_zlib_check_write, &a32, 0, destLen,
+	                         src + 2, sourceLen - 6);
+
+	if (res != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Check Adler-32 checksum -- */
+
+	if (read_be32(&src[sourceLen - 4]) != a32) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+/* Write callback and Adler-32 checksum for tinf_zlib_uncompress_window */
+struct tinf_zlib_window {
+	tinf_write_callback write;
+	void *opaque;
+	unsigned long a32;
+};
+
+/* Write callback that updates the checksum and passes the data on */
+static long TINFCC tinf_zlib_window_write(const void *buf, unsigned long size,
+                                          void *opaque)
+{
+	struct tinf_zlib_window *w = (struct tinf_zlib_window *) opaque;
+
+	w->a32 = TINF_ADLER32_UPDATE(w->a32, buf, size);
+
+	return w->write(buf, size, w->opaque);
+}
+
+static long tinf_zlib_inflate_window(tinf_write_callback write, void *opaque,
+                                     void *window, unsigned long windowLen,
+                                     unsigned long *destLen,
+                                     const void *source,
+                                     unsigned long sourceLen)
+{
+	const unsigned char *src = (const unsigned char *) source;
+	struct tinf_zlib_window w;
+	long res;
+
+	/* -- Check header -- */
+
+	if (tinf_zlib_check_header(src, sourceLen) != TINF_OK) {
+		return TINF_DATA_ERROR;
+	}
+
+	/* -- Decompress data, keeping the window size given by CINFO -- */
+
+	w.write = write;
+	w.opaque = opaque;
+	w.a32 = 1;
+
+	res = tinf_inflate_window(tinf_zlib_window_write, &w, window, windowLen,
+	                          (src[0] >> 4) + 8, destLen,
+	                          src + 2, sourceLen - 6);
+
+	/* Keep TINF_BUF_ERROR, which means the window is too small */
+	if (res != TINF_OK) {
+		return res;
+	}
+
+	/* -- Check Adler-32 checksum -- */
+
+	if (read_be32(&src[sourceLen - 4]) != w.a32) {
+		return TINF_DATA_ERROR;
+	}
+
+	return TINF_OK;
+}
+
+long tinf_zlib_uncompress(void *dest, unsigned long *destLen,
+                         const void *source, unsigned long sourceLen)
+{
+	long res = tinf_zlib_inflate(dest, destLen, source, sourceLen);
+
+	TINF_COUNT_CALL(TINF_API_ZLIB, sourceLen, *destLen, res);
+
+	return res;
+}
+
+long tinf_zlib_uncompress2(void *dest, unsigned long *destLen,
+                           const void *source, unsigned long *sourceLen,
+                           unsigned long *endBit)
+{
+	long res = tinf_zlib_inflate2(dest, destLen, source, sourceLen, endBit);
+
+	TINF_COUNT_CALL(TINF_API_ZLIB2, *sourceLen, *destLen, res);
+
+	return res;
+}
+
+long tinf_zlib_uncompress_alloc(void **dest, unsigned long *destLen,
+                               const void *source, unsigned long sourceLen,
+                               tinf_grow_callback grow, void *opaque)
+{
+	long res = tinf_zlib_inflate_alloc(dest, destLen, source, sourceLen,
+	                                   grow, opaque);
+
+	TINF_COUNT_CALL(TINF_API_ZLIB_ALLOC, sourceLen, *destLen, res);
+
+	return res;
+}
+
+long tinf_zlib_verify(unsigned long *destLen,
+                      const void *source, unsigned long sourceLen)
+{
+	unsigned long dlen = 0;
+	long res = tinf_zlib_inflate_verify(&dlen, source, sourceLen);
+
+	if (destLen != NULL) {
+		*destLen = dlen;
+	}
+
+	TINF_COUNT_CALL(TINF_API_ZLIB_VERIFY, sourceLen, dlen, res);
+
+	return res;
+}
+
+long tinf_zlib_uncompress_window(tinf_write_callback write, void *opaque,
+                                 void *window, unsigned long windowLen,
+                                 unsigned long *destLen,
+                                 const void *source, unsigned long sourceLen)
+{
+	long res = tinf_zlib_inflate_window(write, opaque, window, windowLen,
+	                                    destLen, source, sourceLen);
+
+	TINF_COUNT_CALL(TINF_API_ZLIB_WINDOW, sourceLen,
+	                res == TINF_OK ? *destLen : 0, res);
+
+	return res;
+}
@@ -39,6 +39,148 @@ static const unsigned char robuffer[] = { 0 };
 
 static unsigned char buffer[4096];
 
+/* Pseudo-random bytes that do not depend on rand() */
+static unsigned char lcg_byte(unsigned long *seed)
+{
+	*seed = (*seed * 1103515245UL + 12345) & 0xFFFFFFFFUL;
+
+	return (unsigned char) (*seed >> 16);
+}
+
+/* LSB first bit writer, for building deflate streams in tests */
+struct bit_writer {
+	unsigned char *data;
+	unsigned long len;
+	unsigned long tag;
+	int bitcount;
+};
+
+static void put_bits(struct bit_writer *bw, unsigned long bits, int num)
+{
+	int i;
+
+	for (i = 0; i < num; ++i) {
+		bw->tag |= ((bits >> i) & 1) << bw->bitcount;
+
+		if (++bw->bitcount == 8) {
+			bw->data[bw->len++] = (unsigned char) bw->tag;
+			bw->tag = 0;
+			bw->bitcount = 0;
+		}
+	}
+}
+
+/* Write Huffman code, most significant bit first */
+static void put_code(struct bit_writer *bw, unsigned long code, int num)
+{
+	while (num--) {
+		put_bits(bw, (code >> num) & 1, 1);
+	}
+}
+
+static void flush_bits(struct bit_writer *bw)
+{
+	if (bw->bitcount > 0) {
+		put_bits(bw, 0, 8 - bw->bitcount);
+	}
+}
+
+/*
+ * Build a stream of a stored block of 32768 pseudo-random bytes, followed
+ * by a fixed block of count matches of length 258 at distance 32768, and
+ * return its size. The output is 32768 + 258 * count bytes.
+ */
+static unsigned long build_far_matches(unsigned char *data, long count)
+{
+	struct bit_writer bw = { 0, 0, 0, 0 };
+	unsigned long seed = 1;
+	long i;
+
+	bw.data = data;
+
+	/* Stored block header */
+	put_bits(&bw, 0, 1);
+	put_bits(&bw, 0, 2);
+	flush_bits(&bw);
+	put_bits(&bw, 32768, 16);
+	put_bits(&bw, 32768 ^ 0xFFFF, 16);
+
+	for (i = 0; i < 32768; ++i) {
+		put_bits(&bw, lcg_byte(&seed), 8);
+	}
+
+	/* Fixed block */
+	put_bits(&bw, 1, 1);
+	put_bits(&bw, 1, 2);
+
+	for (i = 0; i < count; ++i) {
+		/* Length code 285 is 11000101, distance code 29 is 11101 */
+		put_code(&bw, 0xC5, 8);
+		put_code(&bw, 29, 5);
+		put_bits(&bw, 32768 - 24577, 13);
+	}
+
+	/* End of block code 256 is 0000000 */
+	put_code(&bw, 0, 7);
+	flush_bits(&bw);
+
+	return bw.len;
+}
+
+/*
+ * Write raw deflate data of 512 pseudo-random bytes followed by count
+ * matches of length 258 at distance 512, for a 512 byte window
+ */
+static unsigned long build_near_matches(unsigned char *data, long count)
+{
+	struct bit_writer bw = { 0, 0, 0, 0 };
+	unsigned long seed = 1;
+	long i;
+
+	bw.data = data;
+
+	/* Stored block header */
+	put_bits(&bw, 0, 1);
+	put_bits(&bw, 0, 2);
+	flush_bits(&bw);
+	put_bits(&bw, 512, 16);
+	put_bits(&bw, 512 ^ 0xFFFF, 16);
+
+	for (i = 0; i < 512; ++i) {
+		put_bits(&bw, lcg_byte(&seed), 8);
+	}
+
+	/* Fixed block */
+	put_bits(&bw, 1, 1);
+	put_bits(&bw, 1, 2);
+
+	for (i = 0; i < count; ++i) {
+		/* Length code 285 is 11000101, distance code 17 is 10001 */
+		put_code(&bw, 0xC5, 8);
+		put_code(&bw, 17, 5);
+		put_bits(&bw, 512 - 385, 7);
+	}
+
+	/* End of block code 256 is 0000000 */
+	put_code(&bw, 0, 7);
+	flush_bits(&bw);
+
+	return bw.len;
+}
+
+/* Large buffer for the checksum tests, longer than the Adler-32 NMAX */
+static unsigned char checksum_data[100000];
+
+static void fill_checksum_data(void)
+{
+	unsigned long seed = 1;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(checksum_data); ++i) {
+		checksum_data[i] = lcg_byte(&seed);
+	}
+}
+
 struct packed_data {
 	unsigned int src_size;
 	unsigned int depacked_size;
@@ -179,7 +321,7 @@ TEST inflate_padding(void)
 	static const unsigned char data[] = {
 		0x03, 0xFC
 	};
-	unsigned int dlen = 0;
+	unsigned long dlen = 0;
 	int res;
 
 	res = tinf_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
@@ -203,7 +345,7 @@ TEST inflate_empty_no_literals(void)
 		0x05, 0xCA, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x90, 0xFF,
 		0x6B, 0x01, 0x00
 	};
-	unsigned int dlen = 0;
+	unsigned long dlen = 0;
 	int res;
 
 	res = tinf_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
@@ -224,7 +366,7 @@ TEST inflate_huffman_only(void)
 		0x00, 0x00, 0x00, 0x00, 0x02
 	};
 	unsigned char out[256];
-	unsigned int dlen = ARRAY_SIZE(out);
+	unsigned long dlen = ARRAY_SIZE(out);
 	int res;
 	int i;
 
@@ -251,7 +393,7 @@ TEST inflate_rle(void)
 		0xA9, 0x07, 0x39, 0x73, 0x01
 	};
 	unsigned char out[256];
-	unsigned int dlen = ARRAY_SIZE(out);
+	unsigned long dlen = ARRAY_SIZE(out);
 	int res;
 	int i;
 
@@ -278,7 +420,7 @@ TEST inflate_max_matchlen(void)
 		0xA9, 0x17, 0xB9, 0x00, 0x2C
 	};
 	unsigned char out[259];
-	unsigned int dlen = ARRAY_SIZE(out);
+	unsigned long dlen = ARRAY_SIZE(out);
 	int res;
 	int i;
 
@@ -311,7 +453,7 @@ TEST inflate_max_matchlen_alt(void)
 		0xA9, 0x07, 0xB9, 0x00, 0xFC, 0x05
 	};
 	unsigned char out[259];
-	unsigned int dlen = ARRAY_SIZE(out);
+	unsigned long dlen = ARRAY_SIZE(out);
 	int res;
 	int i;
 
@@ -342,7 +484,7 @@ TEST inflate_max_matchdist(void)
 		0xFE, 0xFF, 0x05
 	};
 	unsigned char out[32771];
-	unsigned int dlen = ARRAY_SIZE(out);
+	unsigned long dlen = ARRAY_SIZE(out);
 	int res;
 	int i;
 
@@ -375,7 +517,7 @@ TEST inflate_code_length_codes(void)
 		0x77, 0x1E, 0xCA, 0x61, 0x01
 	};
 	unsigned char out[4];
-	unsigned int dlen = ARRAY_SIZE(out);
+	unsigned long dlen = ARRAY_SIZE(out);
 	int res;
 	int i;
 
@@ -404,7 +546,7 @@ TEST inflate_max_codelen(void)
 		0xFF, 0xFE, 0xDF, 0xFF, 0xF7, 0xFF, 0xFB, 0xFF, 0x03
 	};
 	unsigned char out[15];
-	unsigned int dlen = ARRAY_SIZE(out);
+	unsigned long dlen = ARRAY_SIZE(out);
 	int res;
 	int i;
 
@@ -423,235 +565,1301 @@ TEST inflate_max_codelen(void)
 	PASS();
 }
 
-/* Test tinf_uncompress on random data */
-TEST inflate_random(void)
+/* Dynamic blocks with trees A, A, B, A, each followed by a full flush */
+TEST inflate_repeated_trees(void)
 {
-	unsigned char data[256];
-	unsigned int len;
-
-	for (len = 1; len < ARRAY_SIZE(data); ++len) {
-		unsigned int dlen = ARRAY_SIZE(buffer);
-		int i;
-
-		for (i = 0; i < len; ++i) {
-			data[i] = (unsigned char) rand();
+	static const unsigned char data[] = {
+		0x04, 0xC1, 0x01, 0x01, 0x00, 0x00, 0x00, 0x82, 0xA0, 0xAD,
+		0xD8, 0xFF, 0x0F, 0x81, 0x24, 0x49, 0x92, 0x24, 0x49, 0x92,
+		0x24, 0x6D, 0x3B, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x04, 0xC1,
+		0x01, 0x01, 0x00, 0x00, 0x00, 0x82, 0xA0, 0xAD, 0xD8, 0xFF,
+		0x0F, 0x81, 0x24, 0x49, 0x92, 0x24, 0x49, 0x92, 0x24, 0x6D,
+		0x3B, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x04, 0xC1, 0x01, 0x01,
+		0x00, 0x00, 0x00, 0x82, 0xA0, 0xDB, 0xD8, 0xFA, 0x40, 0xD3,
+		0x34, 0x4D, 0xD3, 0x34, 0x4D, 0xD3, 0xC0, 0x01, 0x00, 0x00,
+		0xFF, 0xFF, 0x04, 0xC1, 0x01, 0x01, 0x00, 0x00, 0x00, 0x82,
+		0xA0, 0xAD, 0xD8, 0xFF, 0x0F, 0x81, 0x24, 0x49, 0x92, 0x24,
+		0x49, 0x92, 0x24, 0x6D, 0x3B, 0x00, 0x00, 0x00, 0xFF, 0xFF,
+		0x03, 0x00
+	};
+	unsigned char out[256];
+	unsigned char expected[164];
+	unsigned long dlen = ARRAY_SIZE(out);
+	int res;
+	int i, j, n;
+
+	/* A is "ab" * 20 + "ccc", B is "xyz" * 10 + "xxxxx" */
+	for (n = 0, j = 0; j < 4; ++j) {
+		if (j == 2) {
+			for (i = 0; i < 30; ++i) {
+				expected[n++] = "xyz"[i % 3];
+			}
+			for (i = 0; i < 5; ++i) {
+				expected[n++] = 'x';
+			}
 		}
-
-		/* Make sure btype is valid */
-		if ((data[0] & 0x06) == 0x06) {
-			data[0] &= (rand() > RAND_MAX / 2) ? ~0x02 : ~0x04;
+		else {
+			for (i = 0; i < 40; ++i) {
+				expected[n++] = "ab"[i % 2];
+			}
+			for (i = 0; i < 3; ++i) {
+				expected[n++] = 'c';
+			}
 		}
-
-		tinf_uncompress(buffer, &dlen, data, len);
 	}
 
+	res = tinf_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(expected));
+	ASSERT_MEM_EQ(expected, out, ARRAY_SIZE(expected));
+
 	PASS();
 }
 
-/* Test tinf_uncompress on compressed data with errors */
-TEST inflate_error_case(const void *closure)
+/*
+ * 600, 700 and 1000 bytes repeating every 20, 40 and 100 pseudo-random
+ * bytes, compressed with zlib, to test copying long matches in chunks
+ */
+static const unsigned char long_matches_data[] = {
+	0x3B, 0x56, 0xD7, 0x98, 0xED, 0xFD, 0xFB, 0xD1, 0xEF, 0x90,
+	0x6F, 0x7B, 0xEF, 0xD7, 0xC8, 0x3C, 0x6C, 0x67, 0xDC, 0x6F,
+	0x78, 0xEF, 0xD8, 0xA8, 0xD8, 0xA8, 0x18, 0x85, 0x62, 0x61,
+	0x45, 0xFC, 0xEE, 0xE9, 0x69, 0xED, 0x91, 0xAB, 0x3A, 0x6C,
+	0x22, 0x5F, 0x85, 0x09, 0x57, 0x5F, 0x6A, 0x5D, 0x78, 0xC3,
+	0x26, 0x24, 0x54, 0xDF, 0x7C, 0x5D, 0x6A, 0xF4, 0x2D, 0xA6,
+	0xCA, 0x19, 0x67, 0x1E, 0x4B, 0x95, 0xF5, 0xC5, 0xDF, 0x9C,
+	0x39, 0xAA, 0x6E, 0x54, 0xDD, 0x60, 0x53, 0xD7, 0x2F, 0x6F,
+	0x6F, 0xF6, 0xCE, 0xB9, 0xC2, 0x97, 0xF7, 0xD7, 0xBE, 0x65,
+	0xB7, 0x9E, 0xB4, 0xF5, 0xDD, 0xD1, 0xCC, 0xF5, 0xFB, 0x1F,
+	0xF6, 0xB0, 0x40, 0xE1, 0x77, 0xFF, 0xC6, 0x08, 0xD6, 0x09,
+	0x47, 0x39, 0xEF, 0x04, 0x9F, 0x5D, 0x65, 0xED, 0x31, 0x33,
+	0xE8, 0x72, 0xD0, 0x5C, 0xB6, 0xF9, 0xAF, 0xB6, 0x1E, 0x62,
+	0x13, 0x9E, 0xE1, 0xB9, 0x89, 0x51, 0x6E, 0x8D, 0x51, 0x87,
+	0xE1, 0x9C, 0x20, 0xB7, 0xA9, 0x85, 0x66, 0xFD, 0xE1, 0xDF,
+	0x2C, 0x65, 0xC5, 0x7E, 0x75, 0x94, 0x7C, 0x9D, 0x51, 0x23,
+	0x1E, 0xE3, 0xB8, 0x3B, 0xB7, 0xB0, 0x8F, 0xBF, 0x20, 0xF2,
+	0x38, 0xA3, 0xB4, 0xBE, 0xB1, 0xED, 0xC4, 0x03, 0xB2, 0x4B,
+	0x79, 0x79, 0x47, 0xED, 0x18, 0xB5, 0x63, 0xD4, 0x8E, 0x81,
+	0xB5, 0x03, 0x00
+};
+
+TEST inflate_long_matches(void)
 {
-	const struct packed_data *pd = (const struct packed_data *) closure;
+	static const int period[3] = { 20, 40, 100 };
+	static const int size[3] = { 600, 700, 1000 };
+	unsigned char expect[2300];
+	unsigned long dlen = ARRAY_SIZE(buffer);
+	unsigned long seed = 1;
 	int res;
+	int i, j, pos = 0;
 
-	unsigned int size = pd->depacked_size;
-	res = tinf_uncompress(buffer, &size, pd->data, pd->src_size);
+	for (i = 0; i < 3; ++i) {
+		for (j = 0; j < size[i]; ++j) {
+			expect[pos + j] = j < period[i] ? lcg_byte(&seed)
+			                                : expect[pos + j - period[i]];
+		}
+		pos += size[i];
+	}
 
-	ASSERT(res != TINF_OK);
+	res = tinf_uncompress(buffer, &dlen, long_matches_data,
+	                      ARRAY_SIZE(long_matches_data));
+
+	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(expect));
+
+	ASSERT(memcmp(buffer, expect, ARRAY_SIZE(expect)) == 0);
 
 	PASS();
 }
 
-SUITE(tinflate)
+/* Input for tinf_uncompress_read, returned at most chunk bytes at a time */
+struct read_state {
+	const unsigned char *data;
+	unsigned long size;
+	unsigned long pos;
+	unsigned long chunk;
+};
+
+static long read_chunk(void *buf, unsigned long size, void *opaque)
 {
-	char suffix[32];
-	int i;
+	struct read_state *rs = (struct read_state *) opaque;
+	unsigned long num = rs->size - rs->pos;
 
-	RUN_TEST(inflate_padding);
-	RUN_TEST(inflate_empty_no_literals);
-	RUN_TEST(inflate_huffman_only);
-	RUN_TEST(inflate_rle);
-	RUN_TEST(inflate_max_matchlen);
-	RUN_TEST(inflate_max_matchlen_alt);
-	RUN_TEST(inflate_max_matchdist);
-	RUN_TEST(inflate_code_length_codes);
-	RUN_TEST(inflate_max_codelen);
+	if (num > rs->chunk) {
+		num = rs->chunk;
+	}
+	if (num > size) {
+		num = size;
+	}
 
-	RUN_TEST(inflate_random);
+	memcpy(buf, rs->data + rs->pos, num);
+	rs->pos += num;
 
-	for (i = 0; i < ARRAY_SIZE(inflate_errors); ++i) {
-		sprintf(suffix, "%d", i);
-		greatest_set_test_suffix(suffix);
-		RUN_TEST1(inflate_error_case, &inflate_errors[i]);
-	}
+	return (long) num;
 }
 
-/* tinfzlib */
-
-TEST zlib_empty_raw(void)
+TEST inflate_read(void)
 {
-	/* Empty buffer, uncompressed */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x01, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00,
-		0x01
-	};
-	unsigned int dlen = 0;
+	static const unsigned long chunks[] = { 1, 3, 8, 100, 100000 };
+	unsigned char expect[2300];
+	unsigned long elen = ARRAY_SIZE(expect);
 	int res;
+	int i;
 
-	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+	res = tinf_uncompress(expect, &elen, long_matches_data,
+	                      ARRAY_SIZE(long_matches_data));
 
-	ASSERT(res == TINF_OK && dlen == 0);
+	ASSERT(res == TINF_OK && elen == ARRAY_SIZE(expect));
+
+	for (i = 0; i < ARRAY_SIZE(chunks); ++i) {
+		struct read_state rs;
+		unsigned long dlen = ARRAY_SIZE(buffer);
+
+		rs.data = long_matches_data;
+		rs.size = ARRAY_SIZE(long_matches_data);
+		rs.pos = 0;
+		rs.chunk = chunks[i];
+
+		res = tinf_uncompress_read(buffer, &dlen, read_chunk, &rs);
+
+		ASSERT(res == TINF_OK && dlen == elen);
+		ASSERT(memcmp(buffer, expect, elen) == 0);
+
+		/* Truncated input */
+		rs.size = ARRAY_SIZE(long_matches_data) - 2;
+		rs.pos = 0;
+		dlen = ARRAY_SIZE(buffer);
+
+		res = tinf_uncompress_read(buffer, &dlen, read_chunk, &rs);
+
+		ASSERT(res == TINF_DATA_ERROR);
+	}
 
 	PASS();
 }
 
-TEST zlib_empty_fixed(void)
+TEST inflate_read_stored(void)
 {
-	/* Empty buffer, fixed Huffman */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01
-	};
-	unsigned int dlen = 0;
-	int res;
+	/* Stored block of 3000 bytes, longer than the input buffer */
+	unsigned char data[5 + 3000];
+	unsigned long seed = 1;
+	int i;
 
-	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+	data[0] = 0x01;
+	data[1] = 3000 & 0xFF;
+	data[2] = 3000 >> 8;
+	data[3] = ~data[1];
+	data[4] = ~data[2];
 
-	ASSERT(res == TINF_OK && dlen == 0);
+	for (i = 5; i < ARRAY_SIZE(data); ++i) {
+		data[i] = lcg_byte(&seed);
+	}
+
+	for (i = 1; i < 16; i += 7) {
+		struct read_state rs;
+		unsigned long dlen = ARRAY_SIZE(buffer);
+		int res;
+
+		rs.data = data;
+		rs.size = ARRAY_SIZE(data);
+		rs.pos = 0;
+		rs.chunk = i;
+
+		res = tinf_uncompress_read(buffer, &dlen, read_chunk, &rs);
+
+		ASSERT(res == TINF_OK && dlen == 3000);
+		ASSERT(memcmp(buffer, data + 5, 3000) == 0);
+
+		/* Truncated input */
+		rs.size = ARRAY_SIZE(data) - 1;
+		rs.pos = 0;
+		dlen = ARRAY_SIZE(buffer);
+
+		res = tinf_uncompress_read(buffer, &dlen, read_chunk, &rs);
+
+		ASSERT(res == TINF_DATA_ERROR);
+	}
 
 	PASS();
 }
 
-TEST zlib_empty_dynamic(void)
+/* Check output of build_far_matches, returns non-zero if correct */
+static int check_far_matches(const unsigned char *data, unsigned long size)
 {
-	/* Empty buffer, dynamic Huffman */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x10, 0xFF, 0xD5, 0x08, 0x00, 0x00, 0x00, 0x01
-	};
-	unsigned int dlen = 0;
-	int res;
+	unsigned long seed = 1;
+	unsigned long i;
 
-	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+	/* Every byte repeats the one 32768 bytes back */
+	for (i = 0; i < size; ++i) {
+		unsigned char expect = i < 32768 ? lcg_byte(&seed)
+		                                 : data[i - 32768];
 
-	ASSERT(res == TINF_OK && dlen == 0);
+		if (data[i] != expect) {
+			return 0;
+		}
+	}
 
-	PASS();
+	return 1;
 }
 
-TEST zlib_onebyte_raw(void)
+/* Output from tinf_uncompress_write */
+struct write_state {
+	unsigned char *data;
+	unsigned long size;
+	unsigned long pos;
+	long calls;
+	long fail_at; /* Call to fail, or -1 */
+};
+
+static long write_collect(const void *buf, unsigned long size, void *opaque)
 {
-	/* One byte 00, uncompressed */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x01, 0x01, 0x00, 0xFE, 0xFF, 0x00, 0x00, 0x01,
-		0x00, 0x01
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
-	int res;
+	struct write_state *ws = (struct write_state *) opaque;
 
-	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	if (ws->calls++ == ws->fail_at || ws->size - ws->pos < size) {
+		return 1;
+	}
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+	memcpy(ws->data + ws->pos, buf, size);
+	ws->pos += size;
 
-	PASS();
+	return 0;
 }
 
-TEST zlib_onebyte_fixed(void)
+/* Large buffers for tests with output longer than the 64 KiB window */
+static unsigned char big_src[70000];
+static unsigned char big_out[32768 + 258 * 1200];
+
+TEST inflate_write(void)
 {
-	/* One byte 00, fixed Huffman */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	struct write_state ws;
+	unsigned long slen = build_far_matches(big_src, 1200);
+	unsigned long dlen = 0;
 	int res;
 
-	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	ws.data = big_out;
+	ws.size = ARRAY_SIZE(big_out);
+	ws.pos = 0;
+	ws.calls = 0;
+	ws.fail_at = -1;
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+	res = tinf_uncompress_write(write_collect, &ws, &dlen, big_src, slen);
+
+	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(big_out));
+	ASSERT(ws.pos == dlen && ws.calls > 1);
+
+	ASSERT(check_far_matches(big_out, dlen));
+
+	/* Errors from write are returned as TINF_BUF_ERROR */
+	ws.pos = 0;
+	ws.calls = 0;
+	ws.fail_at = 1;
+
+	res = tinf_uncompress_write(write_collect, &ws, &dlen, big_src, slen);
+
+	ASSERT(res == TINF_BUF_ERROR);
 
 	PASS();
 }
 
-TEST zlib_onebyte_dynamic(void)
+/*
+ * Check that decompressing data from big_src with the first skip bytes
+ * skipped gives the end of the size bytes in big_out
+ */
+static int check_skip(unsigned long slen, unsigned long size,
+                      unsigned long skip)
 {
-	/* One byte 00, dynamic Huffman */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x10, 0xFF, 0xD5, 0x10, 0x00, 0x01, 0x00, 0x01
-	};
-	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	struct write_state ws;
+	unsigned long dlen = 0;
 	int res;
 
-	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	ws.data = big_out + 170000;
+	ws.size = ARRAY_SIZE(big_out) - 170000;
+	ws.pos = 0;
+	ws.calls = 0;
+	ws.fail_at = -1;
 
-	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+	res = tinf_uncompress_skip(write_collect, &ws, skip, &dlen, big_src, slen);
 
-	PASS();
+	if (res != TINF_OK || dlen != size) {
+		return 0;
+	}
+
+	if (skip >= size) {
+		return ws.calls == 0;
+	}
+
+	return ws.pos == size - skip
+	    && memcmp(ws.data, big_out + skip, ws.pos) == 0;
 }
 
-TEST zlib_zeroes(void)
+TEST inflate_skip(void)
 {
-	/* 256 zero bytes, to test unrolling in Adler-32 */
-	static const unsigned char data[] = {
-		0x78, 0x9C, 0x63, 0x60, 0x18, 0xD9, 0x00, 0x00, 0x01, 0x00,
-		0x00, 0x01
+	static const unsigned long far_skip[] = {
+		0, 1, 32767, 32768, 40000, 135967, 135968, 200000
 	};
-	unsigned char out[256];
-	unsigned int dlen = ARRAY_SIZE(out);
+	static const unsigned long stored_skip[] = {
+		1000, 32767, 40000, 65535, 70000
+	};
+	struct bit_writer bw = { 0, 0, 0, 0 };
+	unsigned long seed = 1;
+	unsigned long slen = build_far_matches(big_src, 400);
+	unsigned long dlen = ARRAY_SIZE(big_out);
 	int res;
 	int i;
 
-	memset(out, 0xFF, ARRAY_SIZE(out));
+	res = tinf_uncompress(big_out, &dlen, big_src, slen);
 
-	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	ASSERT(res == TINF_OK && dlen == 32768 + 258 * 400);
 
-	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(out));
+	for (i = 0; i < ARRAY_SIZE(far_skip); ++i) {
+		ASSERT(check_skip(slen, dlen, far_skip[i]));
+	}
 
-	for (i = 0; i < ARRAY_SIZE(out); ++i) {
-		if (out[i]) {
-			FAIL();
-		}
+	/* Largest stored block, most of which need not be copied */
+	bw.data = big_src;
+
+	put_bits(&bw, 0, 1);
+	put_bits(&bw, 0, 2);
+	flush_bits(&bw);
+	put_bits(&bw, 65535, 16);
+	put_bits(&bw, 0, 16);
+
+	for (i = 0; i < 65535; ++i) {
+		put_bits(&bw, lcg_byte(&seed), 8);
 	}
 
-	PASS();
-}
+	/* Fixed block of length 258 distance 32768 matches, as above */
+	put_bits(&bw, 1, 1);
+	put_bits(&bw, 1, 2);
 
-/* Test tinf_zlib_uncompress on compressed data with errors */
-TEST zlib_error_case(const void *closure)
-{
-	const struct packed_data *pd = (const struct packed_data *) closure;
-	int res;
+	for (i = 0; i < 100; ++i) {
+		put_code(&bw, 0xC5, 8);
+		put_code(&bw, 29, 5);
+		put_bits(&bw, 32768 - 24577, 13);
+	}
 
-	unsigned int size = pd->depacked_size;
-	res = tinf_zlib_uncompress(buffer, &size, pd->data, pd->src_size);
+	put_code(&bw, 0, 7);
+	flush_bits(&bw);
 
-	ASSERT(res != TINF_OK);
+	slen = bw.len;
+	dlen = ARRAY_SIZE(big_out);
+
+	res = tinf_uncompress(big_out, &dlen, big_src, slen);
+
+	ASSERT(res == TINF_OK && dlen == 65535 + 258 * 100);
+
+	for (i = 0; i < ARRAY_SIZE(stored_skip); ++i) {
+		ASSERT(check_skip(slen, dlen, stored_skip[i]));
+	}
 
 	PASS();
 }
 
-SUITE(tinfzlib)
+TEST inflate_window(void)
 {
-	char suffix[32];
-	int i;
+	unsigned char window[512 + 1024];
+	struct write_state ws;
+	unsigned long slen = build_near_matches(big_src, 200);
+	unsigned long dlen = 0;
+	unsigned long i;
+	int res;
 
-	RUN_TEST(zlib_empty_raw);
-	RUN_TEST(zlib_empty_fixed);
-	RUN_TEST(zlib_empty_dynamic);
+	ws.data = big_out;
+	ws.size = ARRAY_SIZE(big_out);
+	ws.pos = 0;
+	ws.calls = 0;
+	ws.fail_at = -1;
 
-	RUN_TEST(zlib_onebyte_raw);
-	RUN_TEST(zlib_onebyte_fixed);
-	RUN_TEST(zlib_onebyte_dynamic);
-	RUN_TEST(zlib_zeroes);
+	res = tinf_uncompress_window(write_collect, &ws, window,
+	                             ARRAY_SIZE(window), 9, &dlen, big_src, slen);
 
-	for (i = 0; i < ARRAY_SIZE(zlib_errors); ++i) {
-		sprintf(suffix, "%d", i);
-		greatest_set_test_suffix(suffix);
-		RUN_TEST1(zlib_error_case, &zlib_errors[i]);
+	ASSERT(res == TINF_OK && dlen == 512 + 258 * 200 && ws.pos == dlen);
+
+	/* Every byte after the first 512 repeats the one 512 bytes back */
+	for (i = 512; i < dlen; ++i) {
+		ASSERT(big_out[i] == big_out[i - 512]);
 	}
-}
+
+	/* Window too small for window size, and window size out of range */
+	res = tinf_uncompress_window(write_collect, &ws, window,
+	                             ARRAY_SIZE(window) - 1, 9, &dlen,
+	                             big_src, slen);
+
+	ASSERT(res == TINF_BUF_ERROR);
+
+	res = tinf_uncompress_window(write_collect, &ws, window,
+	                             ARRAY_SIZE(window), 16, &dlen,
+	                             big_src, slen);
+
+	ASSERT(res == TINF_BUF_ERROR);
+
+	/* Distance 512 with a 256 byte window */
+	ws.pos = 0;
+
+	res = tinf_uncompress_window(write_collect, &ws, window,
+	                             ARRAY_SIZE(window), 8, &dlen,
+	                             big_src, slen);
+
+	ASSERT(res == TINF_DATA_ERROR);
+
+	/* Same for a single match, before the window is ever flushed */
+	slen = build_near_matches(big_src, 1);
+	ws.pos = 0;
+
+	res = tinf_uncompress_window(write_collect, &ws, window,
+	                             ARRAY_SIZE(window), 8, &dlen,
+	                             big_src, slen);
+
+	ASSERT(res == TINF_DATA_ERROR);
+
+	PASS();
+}
+
+TEST inflate_uncompress2(void)
+{
+	/* Followed by one byte 00, fixed Huffman, and a byte of garbage */
+	static const unsigned char next_data[] = { 0x63, 0x00, 0x00, 0xAA };
+	unsigned char data[ARRAY_SIZE(long_matches_data) + 4];
+	unsigned long n = ARRAY_SIZE(long_matches_data);
+	unsigned long dlen = ARRAY_SIZE(buffer);
+	unsigned long slen = ARRAY_SIZE(data);
+	unsigned long bits = 0;
+	int res;
+
+	memcpy(data, long_matches_data, n);
+	memcpy(data + n, next_data, 4);
+
+	res = tinf_uncompress2(buffer, &dlen, data, &slen, &bits);
+
+	ASSERT(res == TINF_OK && dlen == 2300);
+	ASSERT(slen == n && bits > 8 * (n - 1) && bits <= 8 * n);
+
+	dlen = ARRAY_SIZE(buffer);
+	slen = 4;
+
+	res = tinf_uncompress2(buffer, &dlen, data + n, &slen, &bits);
+
+	ASSERT(res == TINF_OK && dlen == 1 && buffer[0] == 0);
+	ASSERT(slen == 3 && bits == 18);
+
+	PASS();
+}
+
+TEST inflate_prefix(void)
+{
+	unsigned char out[2300];
+	unsigned long full_len = ARRAY_SIZE(buffer);
+	unsigned long last_slen = 0;
+	unsigned long dlen, slen, n;
+	int res;
+
+	res = tinf_uncompress(buffer, &full_len, long_matches_data,
+	                      ARRAY_SIZE(long_matches_data));
+
+	ASSERT(res == TINF_OK && full_len == ARRAY_SIZE(out));
+
+	/* Every prefix, ending in literals and in the middle of matches */
+	for (n = 0; n <= full_len; ++n) {
+		dlen = n;
+		slen = ARRAY_SIZE(long_matches_data);
+
+		res = tinf_uncompress_prefix(out, &dlen, long_matches_data, &slen);
+
+		ASSERT(res == (n < full_len ? TINF_OUTPUT_FULL : TINF_OK));
+		ASSERT(dlen == n && memcmp(out, buffer, n) == 0);
+		ASSERT(slen >= last_slen && slen <= ARRAY_SIZE(long_matches_data));
+
+		last_slen = slen;
+	}
+
+	ASSERT_EQ(ARRAY_SIZE(long_matches_data), slen);
+
+	/* Only the input for the prefix needs to be there */
+	build_far_matches(big_src, 400);
+	slen = 1100;
+	dlen = 1000;
+
+	res = tinf_uncompress_prefix(big_out, &dlen, big_src, &slen);
+
+	ASSERT(res == TINF_OUTPUT_FULL && dlen == 1000);
+	ASSERT(check_far_matches(big_out, dlen));
+
+	/* One byte of block header, four of stored block length */
+	ASSERT_EQ(1005, slen);
+
+	/*
+	 * Input cut short, the output is either a correct prefix from the
+	 * input given, or an error
+	 */
+	for (n = 0; n < ARRAY_SIZE(long_matches_data); ++n) {
+		unsigned long size;
+
+		for (size = 1; size <= full_len; size += 97) {
+			dlen = size;
+			slen = n;
+
+			res = tinf_uncompress_prefix(out, &dlen, long_matches_data,
+			                             &slen);
+
+			if (res != TINF_DATA_ERROR) {
+				ASSERT_EQ(TINF_OUTPUT_FULL, res);
+				ASSERT(dlen == size && memcmp(out, buffer, size) == 0);
+				ASSERT(slen <= n);
+			}
+		}
+	}
+
+	PASS();
+}
+
+/* Calls to grow_counted, fails when calls reaches grow_fail_at */
+static long grow_calls;
+static long grow_fail_at;
+
+static void *grow_counted(void *ptr, unsigned long size, void *opaque)
+{
+	unsigned long *last_size = (unsigned long *) opaque;
+
+	if (++grow_calls == grow_fail_at) {
+		return NULL;
+	}
+
+	*last_size = size;
+
+	return realloc(ptr, size);
+}
+
+TEST inflate_alloc(void)
+{
+	unsigned long slen = build_far_matches(big_src, 400);
+	unsigned long size = 0;
+	unsigned long dlen = 0;
+	void *out = NULL;
+	int res;
+
+	/* Default allocator, starting from 4 KiB */
+	res = tinf_uncompress_alloc(&out, &dlen, big_src, slen, NULL, NULL);
+
+	ASSERT(res == TINF_OK && dlen == 32768 + 258 * 400);
+	ASSERT(check_far_matches((unsigned char *) out, dlen));
+
+	free(out);
+
+	/* Grow from one byte, stored block data fills it first */
+	out = NULL;
+	dlen = 1;
+	grow_calls = 0;
+	grow_fail_at = -1;
+
+	res = tinf_uncompress_alloc(&out, &dlen, big_src, slen,
+	                            grow_counted, &size);
+
+	ASSERT(res == TINF_OK && dlen == 32768 + 258 * 400);
+	ASSERT(check_far_matches((unsigned char *) out, dlen));
+	ASSERT(size >= dlen && size < 2 * dlen && grow_calls > 2);
+
+	free(out);
+
+	/* Failure to grow is returned as TINF_BUF_ERROR, buffer is kept */
+	out = NULL;
+	dlen = 0;
+	grow_calls = 0;
+	grow_fail_at = 4;
+
+	res = tinf_uncompress_alloc(&out, &dlen, big_src, slen,
+	                            grow_counted, &size);
+
+	ASSERT(res == TINF_BUF_ERROR && out != NULL && grow_calls == 4);
+
+	free(out);
+
+	PASS();
+}
+
+static unsigned char iov_mem[9 * 16384];
+
+/*
+ * Point iovecs of the sizes in len at iov_mem, last one first, so matches
+ * that span iovecs cannot be copied from contiguous memory by mistake.
+ */
+static void reverse_iov(struct tinf_iovec *iov, const unsigned long *len,
+                        unsigned long count)
+{
+	unsigned long pos = ARRAY_SIZE(iov_mem);
+	unsigned long i;
+
+	for (i = 0; i < count; ++i) {
+		pos -= len[i];
+		iov[i].iov_base = iov_mem + pos;
+		iov[i].iov_len = len[i];
+	}
+}
+
+/* Copy the first size bytes of the data in iovecs to out */
+static void gather_iov(unsigned char *out, const struct tinf_iovec *iov,
+                       unsigned long size)
+{
+	while (size > 0) {
+		unsigned long num = iov->iov_len < size ? iov->iov_len : size;
+
+		memcpy(out, iov->iov_base, num);
+		out += num;
+		size -= num;
+		++iov;
+	}
+}
+
+TEST inflate_iov(void)
+{
+	struct tinf_iovec iov[1000];
+	unsigned long len[1000];
+	unsigned char out[2300];
+	unsigned long slen = build_far_matches(big_src, 400);
+	unsigned long dlen = 0;
+	unsigned long i;
+	int res;
+
+	/* 16 KiB pages, matches reach back across two of them */
+	for (i = 0; i < 9; ++i) {
+		len[i] = 16384;
+	}
+
+	reverse_iov(iov, len, 9);
+
+	res = tinf_uncompress_iov(iov, 9, &dlen, big_src, slen);
+
+	ASSERT(res == TINF_OK && dlen == 32768 + 258 * 400);
+
+	gather_iov(big_out, iov, dlen);
+
+	ASSERT(check_far_matches(big_out, dlen));
+
+	/* Too few pages */
+	res = tinf_uncompress_iov(iov, 8, &dlen, big_src, slen);
+
+	ASSERT(res == TINF_BUF_ERROR);
+
+	/* Buffers of 0 to 6 bytes, overlapping matches span several */
+	for (i = 0; i < ARRAY_SIZE(len); ++i) {
+		len[i] = (i * 5) % 7;
+	}
+
+	reverse_iov(iov, len, ARRAY_SIZE(len));
+
+	res = tinf_uncompress_iov(iov, ARRAY_SIZE(iov), &dlen, long_matches_data,
+	                          ARRAY_SIZE(long_matches_data));
+
+	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(out));
+
+	gather_iov(out, iov, dlen);
+
+	dlen = ARRAY_SIZE(buffer);
+
+	res = tinf_uncompress(buffer, &dlen, long_matches_data,
+	                      ARRAY_SIZE(long_matches_data));
+
+	ASSERT(res == TINF_OK && memcmp(out, buffer, ARRAY_SIZE(out)) == 0);
+
+	PASS();
+}
+
+#ifdef TINF_BLOCK_STATS
+struct block_log {
+	struct tinf_block_stats stats[4];
+	int count;
+};
+
+static void record_block_stats(const struct tinf_block_stats *stats, void *opaque)
+{
+	struct block_log *log = (struct block_log *) opaque;
+
+	if (log->count < (int) ARRAY_SIZE(log->stats)) {
+		log->stats[log->count] = *stats;
+	}
+	log->count++;
+}
+
+/* Same clock as the library uses for block times */
+static unsigned long clock_ns(void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long) ts.tv_sec * 1000000000UL
+	     + (unsigned long) ts.tv_nsec;
+#else
+	return (unsigned long) ((double) clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
+
+TEST inflate_block_stats(void)
+{
+	/* 256 zero bytes compressed using RLE (only one distance code) */
+	static const unsigned char data[] = {
+		0xE5, 0xC0, 0x81, 0x00, 0x00, 0x00, 0x00, 0x80, 0xA0, 0xFC,
+		0xA9, 0x07, 0x39, 0x73, 0x01
+	};
+	/* One byte 00 uncompressed, then one byte 00 fixed Huffman */
+	static const unsigned char data2[] = {
+		0x00, 0x01, 0x00, 0xFE, 0xFF, 0x00, 0x63, 0x00, 0x00
+	};
+	struct block_log log;
+	struct tinf_block_stats *stats = &log.stats[0];
+	unsigned char out[256];
+	unsigned long dlen = ARRAY_SIZE(out);
+	unsigned long start, elapsed;
+	int res;
+	int i;
+
+	memset(&log, 0, sizeof(log));
+
+	tinf_set_block_callback(record_block_stats, &log);
+	start = clock_ns();
+	res = tinf_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+	elapsed = clock_ns() - start;
+	tinf_set_block_callback(NULL, NULL);
+
+	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(out));
+
+	ASSERT_EQ(1, log.count);
+	ASSERT_EQ(2, stats->type);
+	ASSERT_EQ(0, stats->in_start);
+	ASSERT_EQ(114, stats->in_end);
+	ASSERT_EQ(0, stats->out_start);
+	ASSERT_EQ(256, stats->out_end);
+	ASSERT_EQ(1, stats->literals);
+	ASSERT_EQ(1, stats->matches);
+
+	/* Both times fall within the call */
+	ASSERT(stats->tree_time <= elapsed);
+	ASSERT(stats->decode_time <= elapsed - stats->tree_time);
+
+	/* Length 255 is code 284, distance 1 is code 0 */
+	for (i = 0; i < 29; ++i) {
+		ASSERT_EQ(i == 284 - 257, stats->length_counts[i]);
+	}
+	for (i = 0; i < 30; ++i) {
+		ASSERT_EQ(i == 0, stats->dist_counts[i]);
+	}
+
+	memset(&log, 0, sizeof(log));
+	dlen = ARRAY_SIZE(out);
+
+	tinf_set_block_callback(record_block_stats, &log);
+	res = tinf_uncompress(out, &dlen, data2, ARRAY_SIZE(data2));
+	tinf_set_block_callback(NULL, NULL);
+
+	ASSERT(res == TINF_OK && dlen == 2);
+
+	ASSERT_EQ(2, log.count);
+	ASSERT_EQ(0, log.stats[0].type);
+	ASSERT_EQ(48, log.stats[0].in_end);
+	ASSERT_EQ(1, log.stats[0].out_end);
+	ASSERT_EQ(1, log.stats[1].type);
+	ASSERT_EQ(48, log.stats[1].in_start);
+	ASSERT_EQ(1, log.stats[1].literals);
+	ASSERT_EQ(0, log.stats[1].matches);
+
+	/* Only dynamic blocks have trees to build */
+	for (i = 0; i < log.count; ++i) {
+		ASSERT_EQ(0, log.stats[i].tree_time);
+	}
+
+	PASS();
+}
+#endif
+
+/* Test tinf_uncompress on random data */
+TEST inflate_random(void)
+{
+	unsigned char data[256];
+	unsigned int len;
+
+	for (len = 1; len < ARRAY_SIZE(data); ++len) {
+		unsigned long dlen = ARRAY_SIZE(buffer);
+		int i;
+
+		for (i = 0; i < len; ++i) {
+			data[i] = (unsigned char) rand();
+		}
+
+		/* Make sure btype is valid */
+		if ((data[0] & 0x06) == 0x06) {
+			data[0] &= (rand() > RAND_MAX / 2) ? ~0x02 : ~0x04;
+		}
+
+		tinf_uncompress(buffer, &dlen, data, len);
+	}
+
+	PASS();
+}
+
+/* Test tinf_uncompress on compressed data with errors */
+TEST inflate_error_case(const void *closure)
+{
+	const struct packed_data *pd = (const struct packed_data *) closure;
+	int res;
+
+	unsigned long size = pd->depacked_size;
+	res = tinf_uncompress(buffer, &size, pd->data, pd->src_size);
+
+	ASSERT(res != TINF_OK);
+
+	PASS();
+}
+
+SUITE(tinflate)
+{
+	char suffix[32];
+	int i;
+
+	RUN_TEST(inflate_padding);
+	RUN_TEST(inflate_empty_no_literals);
+	RUN_TEST(inflate_huffman_only);
+	RUN_TEST(inflate_rle);
+	RUN_TEST(inflate_max_matchlen);
+	RUN_TEST(inflate_max_matchlen_alt);
+	RUN_TEST(inflate_max_matchdist);
+	RUN_TEST(inflate_code_length_codes);
+	RUN_TEST(inflate_max_codelen);
+	RUN_TEST(inflate_repeated_trees);
+	RUN_TEST(inflate_long_matches);
+	RUN_TEST(inflate_read);
+	RUN_TEST(inflate_read_stored);
+	RUN_TEST(inflate_write);
+	RUN_TEST(inflate_skip);
+	RUN_TEST(inflate_window);
+	RUN_TEST(inflate_alloc);
+	RUN_TEST(inflate_uncompress2);
+	RUN_TEST(inflate_prefix);
+	RUN_TEST(inflate_iov);
+
+#ifdef TINF_BLOCK_STATS
+	RUN_TEST(inflate_block_stats);
+#endif
+
+	RUN_TEST(inflate_random);
+
+	for (i = 0; i < ARRAY_SIZE(inflate_errors); ++i) {
+		sprintf(suffix, "%d", i);
+		greatest_set_test_suffix(suffix);
+		RUN_TEST1(inflate_error_case, &inflate_errors[i]);
+	}
+}
+
+/* tinfzlib */
+
+TEST zlib_empty_raw(void)
+{
+	/* Empty buffer, uncompressed */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x01, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00,
+		0x01
+	};
+	unsigned long dlen = 0;
+	int res;
+
+	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 0);
+
+	PASS();
+}
+
+TEST zlib_empty_fixed(void)
+{
+	/* Empty buffer, fixed Huffman */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01
+	};
+	unsigned long dlen = 0;
+	int res;
+
+	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 0);
+
+	PASS();
+}
+
+TEST zlib_empty_dynamic(void)
+{
+	/* Empty buffer, dynamic Huffman */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x10, 0xFF, 0xD5, 0x08, 0x00, 0x00, 0x00, 0x01
+	};
+	unsigned long dlen = 0;
+	int res;
+
+	res = tinf_zlib_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 0);
+
+	PASS();
+}
+
+TEST zlib_onebyte_raw(void)
+{
+	/* One byte 00, uncompressed */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x01, 0x01, 0x00, 0xFE, 0xFF, 0x00, 0x00, 0x01,
+		0x00, 0x01
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned long dlen = 1;
+	int res;
+
+	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST zlib_onebyte_fixed(void)
+{
+	/* One byte 00, fixed Huffman */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned long dlen = 1;
+	int res;
+
+	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST zlib_onebyte_dynamic(void)
+{
+	/* One byte 00, dynamic Huffman */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x10, 0xFF, 0xD5, 0x10, 0x00, 0x01, 0x00, 0x01
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned long dlen = 1;
+	int res;
+
+	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	PASS();
+}
+
+TEST zlib_zeroes(void)
+{
+	/* 256 zero bytes, to test unrolling in Adler-32 */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x63, 0x60, 0x18, 0xD9, 0x00, 0x00, 0x01, 0x00,
+		0x00, 0x01
+	};
+	unsigned char out[256];
+	unsigned long dlen = ARRAY_SIZE(out);
+	int res;
+	int i;
+
+	memset(out, 0xFF, ARRAY_SIZE(out));
+
+	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == ARRAY_SIZE(out));
+
+	for (i = 0; i < ARRAY_SIZE(out); ++i) {
+		if (out[i]) {
+			FAIL();
+		}
+	}
+
+	PASS();
+}
+
+TEST zlib_alloc(void)
+{
+	/* 256 zero bytes */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x63, 0x60, 0x18, 0xD9, 0x00, 0x00, 0x01, 0x00,
+		0x00, 0x01
+	};
+	static const unsigned char bad_data[] = {
+		0x78, 0x9C, 0x63, 0x60, 0x18, 0xD9, 0x00, 0x00, 0x01, 0x00,
+		0x00, 0x02
+	};
+	unsigned char *out = NULL;
+	unsigned long dlen = 16;
+	int res;
+	int i;
+
+	res = tinf_zlib_uncompress_alloc((void **) &out, &dlen,
+	                                 data, ARRAY_SIZE(data), NULL, NULL);
+
+	ASSERT(res == TINF_OK && dlen == 256);
+
+	for (i = 0; i < 256; ++i) {
+		if (out[i]) {
+			FAIL();
+		}
+	}
+
+	/* Adler-32 checksum error, with buffer from the previous call */
+	res = tinf_zlib_uncompress_alloc((void **) &out, &dlen,
+	                                 bad_data, ARRAY_SIZE(bad_data),
+	                                 NULL, NULL);
+
+	ASSERT(res == TINF_DATA_ERROR && out != NULL);
+
+	free(out);
+
+	PASS();
+}
+
+TEST zlib_uncompress2(void)
+{
+	/* One byte 00, fixed Huffman, twice */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01,
+		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned long dlen = 1;
+	unsigned long slen = ARRAY_SIZE(data);
+	unsigned long bits = 0;
+	int res;
+
+	res = tinf_zlib_uncompress2(out, &dlen, data, &slen, &bits);
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+	ASSERT(slen == 9 && bits == 16 + 18);
+
+	out[0] = 0xFF;
+	slen = ARRAY_SIZE(data) - 9;
+
+	res = tinf_zlib_uncompress2(out, &dlen, data + 9, &slen, NULL);
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0 && slen == 9);
+
+	/* Adler-32 checksum cut off */
+	slen = 8;
+
+	res = tinf_zlib_uncompress2(out, &dlen, data, &slen, NULL);
+
+	ASSERT(res == TINF_DATA_ERROR);
+
+	PASS();
+}
+
+TEST zlib_verify(void)
+{
+	unsigned long slen = 2 + build_far_matches(big_src + 2, 400);
+	unsigned long dlen = ARRAY_SIZE(big_out);
+	unsigned long a32;
+	int res;
+
+	/* Far matches in a zlib stream, output passes through the window */
+	res = tinf_uncompress(big_out, &dlen, big_src + 2, slen - 2);
+
+	ASSERT(res == TINF_OK);
+
+	a32 = tinf_adler32(big_out, dlen);
+
+	big_src[0] = 0x78;
+	big_src[1] = 0x9C;
+	big_src[slen++] = (unsigned char) (a32 >> 24);
+	big_src[slen++] = (unsigned char) (a32 >> 16);
+	big_src[slen++] = (unsigned char) (a32 >> 8);
+	big_src[slen++] = (unsigned char) a32;
+
+	dlen = 0;
+
+	res = tinf_zlib_verify(&dlen, big_src, slen);
+
+	ASSERT(res == TINF_OK && dlen == 32768 + 258 * 400);
+
+	/* Adler-32 checksum error */
+	big_src[slen - 1] ^= 1;
+
+	res = tinf_zlib_verify(NULL, big_src, slen);
+
+	ASSERT(res == TINF_DATA_ERROR);
+
+	PASS();
+}
+
+TEST zlib_window(void)
+{
+	unsigned char window[512 + 1024];
+	struct write_state ws;
+	unsigned long slen = 2 + build_near_matches(big_src + 2, 200);
+	unsigned long dlen = ARRAY_SIZE(big_out);
+	unsigned long a32;
+	int res;
+
+	res = tinf_uncompress(big_out, &dlen, big_src + 2, slen - 2);
+
+	ASSERT(res == TINF_OK);
+
+	a32 = tinf_adler32(big_out, dlen);
+
+	/* CINFO 1 for a 512 byte window */
+	big_src[0] = 0x18;
+	big_src[1] = 0x19;
+	big_src[slen++] = (unsigned char) (a32 >> 24);
+	big_src[slen++] = (unsigned char) (a32 >> 16);
+	big_src[slen++] = (unsigned char) (a32 >> 8);
+	big_src[slen++] = (unsigned char) a32;
+
+	ws.data = big_out + 60000;
+	ws.size = ARRAY_SIZE(big_out) - 60000;
+	ws.pos = 0;
+	ws.calls = 0;
+	ws.fail_at = -1;
+
+	res = tinf_zlib_uncompress_window(write_collect, &ws, window,
+	                                  ARRAY_SIZE(window), &dlen,
+	                                  big_src, slen);
+
+	ASSERT(res == TINF_OK && dlen == 512 + 258 * 200 && ws.pos == dlen);
+	ASSERT(memcmp(ws.data, big_out, dlen) == 0);
+
+	/* Window too small for CINFO 2 */
+	big_src[0] = 0x28;
+	big_src[1] = 0x15;
+
+	res = tinf_zlib_uncompress_window(write_collect, &ws, window,
+	                                  ARRAY_SIZE(window), &dlen,
+	                                  big_src, slen);
+
+	ASSERT(res == TINF_BUF_ERROR);
+
+	/* CINFO 0 for a 256 byte window, which the distances exceed */
+	big_src[0] = 0x08;
+	big_src[1] = 0x1D;
+	ws.pos = 0;
+
+	res = tinf_zlib_uncompress_window(write_collect, &ws, window,
+	                                  ARRAY_SIZE(window), &dlen,
+	                                  big_src, slen);
+
+	ASSERT(res == TINF_DATA_ERROR);
+
+	PASS();
+}
+
+TEST zlib_adler32(void)
+{
+	fill_checksum_data();
+
+	ASSERT(tinf_adler32(checksum_data, 0) == 0x00000001UL);
+	ASSERT(tinf_adler32(checksum_data, 1) == 0x00C700C7UL);
+	ASSERT(tinf_adler32(checksum_data, ARRAY_SIZE(checksum_data))
+	       == 0xA0E54A09UL);
+
+	PASS();
+}
+
+#ifdef TINF_COUNTERS
+TEST zlib_counters(void)
+{
+	/* One byte 00, fixed Huffman */
+	static const unsigned char data[] = {
+		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01
+	};
+	static const unsigned char bad_data[] = {
+		0x78, 0x9C, 0x63, 0x00, 0x00, 0x00, 0x01, 0x00, 0x02
+	};
+	struct tinf_counters before, after;
+	unsigned char out[] = { 0xFF };
+	unsigned long dlen = 1;
+	char text[8192];
+	unsigned long len;
+	int res;
+
+	tinf_get_counters(&before);
+
+	res = tinf_zlib_uncompress(out, &dlen, data, ARRAY_SIZE(data));
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+
+	/* Adler-32 checksum error */
+	dlen = 1;
+	res = tinf_zlib_uncompress(out, &dlen, bad_data, ARRAY_SIZE(bad_data));
+
+	ASSERT(res == TINF_DATA_ERROR);
+
+	tinf_get_counters(&after);
+
+	ASSERT_EQ(2, after.calls[TINF_API_ZLIB] - before.calls[TINF_API_ZLIB]);
+	ASSERT_EQ(0, after.calls[TINF_API_UNCOMPRESS] - before.calls[TINF_API_UNCOMPRESS]);
+	ASSERT_EQ(18, after.bytes_in[TINF_API_ZLIB] - before.bytes_in[TINF_API_ZLIB]);
+	ASSERT_EQ(1, after.bytes_out[TINF_API_ZLIB] - before.bytes_out[TINF_API_ZLIB]);
+	ASSERT_EQ(1, after.data_errors[TINF_API_ZLIB] - before.data_errors[TINF_API_ZLIB]);
+	ASSERT_EQ(2, after.blocks[1] - before.blocks[1]);
+	ASSERT_EQ(2, after.checksum_bytes[TINF_CHECKSUM_ADLER32]
+	           - before.checksum_bytes[TINF_CHECKSUM_ADLER32]);
+
+	len = tinf_format_counters(text, sizeof(text));
+
+	ASSERT(len > 0 && len < sizeof(text) && strlen(text) == len);
+	ASSERT(strstr(text, "# TYPE tinf_calls_total counter\n") != NULL);
+	ASSERT(strstr(text, "tinf_calls_total{api=\"zlib_uncompress\"} ") != NULL);
+
+	/* Truncated output is zero terminated and reports the full length */
+	ASSERT_EQ(len, tinf_format_counters(text, 10));
+	ASSERT_EQ(9, strlen(text));
+
+	PASS();
+}
+#endif
+
+/* Test tinf_zlib_uncompress on compressed data with errors */
+TEST zlib_error_case(const void *closure)
+{
+	const struct packed_data *pd = (const struct packed_data *) closure;
+	int res;
+
+	unsigned long size = pd->depacked_size;
+	res = tinf_zlib_uncompress(buffer, &size, pd->data, pd->src_size);
+
+	ASSERT(res != TINF_OK);
+
+	PASS();
+}
+
+SUITE(tinfzlib)
+{
+	char suffix[32];
+	int i;
+
+	RUN_TEST(zlib_empty_raw);
+	RUN_TEST(zlib_empty_fixed);
+	RUN_TEST(zlib_empty_dynamic);
+
+	RUN_TEST(zlib_onebyte_raw);
+	RUN_TEST(zlib_onebyte_fixed);
+	RUN_TEST(zlib_onebyte_dynamic);
+	RUN_TEST(zlib_zeroes);
+	RUN_TEST(zlib_alloc);
+	RUN_TEST(zlib_uncompress2);
+	RUN_TEST(zlib_verify);
+	RUN_TEST(zlib_window);
+	RUN_TEST(zlib_adler32);
+
+#ifdef TINF_COUNTERS
+	RUN_TEST(zlib_counters);
+#endif
+
+	for (i = 0; i < ARRAY_SIZE(zlib_errors); ++i) {
+		sprintf(suffix, "%d", i);
+		greatest_set_test_suffix(suffix);
+		RUN_TEST1(zlib_error_case, &zlib_errors[i]);
+	}
+}
 
 /* tinfgzip */
 
@@ -663,7 +1871,7 @@ TEST gzip_empty_raw(void)
 		0x01, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00,
 		0x00, 0x00, 0x00
 	};
-	unsigned int dlen = 0;
+	unsigned long dlen = 0;
 	int res;
 
 	res = tinf_gzip_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
@@ -680,7 +1888,7 @@ TEST gzip_empty_fixed(void)
 		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
 		0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 	};
-	unsigned int dlen = 0;
+	unsigned long dlen = 0;
 	int res;
 
 	res = tinf_gzip_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
@@ -698,7 +1906,7 @@ TEST gzip_empty_dynamic(void)
 		0x05, 0xC1, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0xFF,
 		0xD5, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 	};
-	unsigned int dlen = 0;
+	unsigned long dlen = 0;
 	int res;
 
 	res = tinf_gzip_uncompress((void *) robuffer, &dlen, data, ARRAY_SIZE(data));
@@ -717,7 +1925,7 @@ TEST gzip_onebyte_raw(void)
 		0x01, 0x00, 0x00, 0x00
 	};
 	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	unsigned long dlen = 1;
 	int res;
 
 	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
@@ -736,7 +1944,7 @@ TEST gzip_onebyte_fixed(void)
 		0x00
 	};
 	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	unsigned long dlen = 1;
 	int res;
 
 	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
@@ -755,7 +1963,7 @@ TEST gzip_onebyte_dynamic(void)
 		0xD5, 0x10, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
 	};
 	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	unsigned long dlen = 1;
 	int res;
 
 	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
@@ -774,7 +1982,7 @@ TEST gzip_fhcrc(void)
 		0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
 	};
 	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	unsigned long dlen = 1;
 	int res;
 
 	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
@@ -793,7 +2001,7 @@ TEST gzip_fextra(void)
 		0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
 	};
 	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	unsigned long dlen = 1;
 	int res;
 
 	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
@@ -812,7 +2020,7 @@ TEST gzip_fname(void)
 		0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
 	};
 	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	unsigned long dlen = 1;
 	int res;
 
 	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
@@ -831,7 +2039,7 @@ TEST gzip_fcomment(void)
 		0xFF, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00, 0x00
 	};
 	unsigned char out[] = { 0xFF };
-	unsigned int dlen = 1;
+	unsigned long dlen = 1;
 	int res;
 
 	res = tinf_gzip_uncompress(out, &dlen, data, ARRAY_SIZE(data));
@@ -841,13 +2049,104 @@ TEST gzip_fcomment(void)
 	PASS();
 }
 
+TEST gzip_verify(void)
+{
+	static const unsigned char header[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03
+	};
+	unsigned long slen = 10 + build_far_matches(big_src + 10, 400);
+	unsigned long dlen = ARRAY_SIZE(big_out);
+	unsigned long crc;
+	int res;
+	int i;
+
+	/* Far matches in a gzip member, output passes through the window */
+	res = tinf_uncompress(big_out, &dlen, big_src + 10, slen - 10);
+
+	ASSERT(res == TINF_OK);
+
+	crc = tinf_crc32(big_out, dlen);
+
+	memcpy(big_src, header, ARRAY_SIZE(header));
+
+	for (i = 0; i < 4; ++i) {
+		big_src[slen + i] = (unsigned char) (crc >> (8 * i));
+		big_src[slen + 4 + i] = (unsigned char) (dlen >> (8 * i));
+	}
+
+	slen += 8;
+	dlen = 0;
+
+	res = tinf_gzip_verify(&dlen, big_src, slen);
+
+	ASSERT(res == TINF_OK && dlen == 32768 + 258 * 400);
+
+	/* Length error */
+	big_src[slen - 4] ^= 1;
+
+	res = tinf_gzip_verify(NULL, big_src, slen);
+
+	ASSERT(res == TINF_DATA_ERROR);
+
+	/* CRC32 error */
+	big_src[slen - 4] ^= 1;
+	big_src[slen - 8] ^= 1;
+
+	res = tinf_gzip_verify(NULL, big_src, slen);
+
+	ASSERT(res == TINF_DATA_ERROR);
+
+	PASS();
+}
+
+TEST gzip_crc32(void)
+{
+	fill_checksum_data();
+
+	ASSERT(tinf_crc32(checksum_data, 0) == 0x00000000UL);
+	ASSERT(tinf_crc32(checksum_data, 1) == 0xA0058808UL);
+	ASSERT(tinf_crc32(checksum_data, ARRAY_SIZE(checksum_data))
+	       == 0xDD0D690DUL);
+
+	PASS();
+}
+
 /* Test tinf_gzip_uncompress on compressed data with errors */
+TEST gzip_uncompress2(void)
+{
+	/* One byte 00, fixed Huffman, followed by other data */
+	static const unsigned char data[] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0B,
+		0x63, 0x00, 0x00, 0x8D, 0xEF, 0x02, 0xD2, 0x01, 0x00, 0x00,
+		0x00, 0x1F, 0x8B, 0x08
+	};
+	unsigned char out[] = { 0xFF };
+	unsigned long dlen = 1;
+	unsigned long slen = ARRAY_SIZE(data);
+	unsigned long bits = 0;
+	int res;
+
+	res = tinf_gzip_uncompress2(out, &dlen, data, &slen, &bits);
+
+	ASSERT(res == TINF_OK && dlen == 1 && out[0] == 0);
+	ASSERT(slen == 21 && bits == 8 * 10 + 18);
+
+	/* Trailer cut off */
+	slen = 20;
+
+	res = tinf_gzip_uncompress2(out, &dlen, data, &slen, NULL);
+
+	ASSERT(res == TINF_DATA_ERROR);
+
+	PASS();
+}
+
 TEST gzip_error_case(const void *closure)
 {
 	const struct packed_data *pd = (const struct packed_data *) closure;
 	int res;
 
-	unsigned int size = pd->depacked_size;
+	unsigned long size = pd->depacked_size;
 	res = tinf_gzip_uncompress(buffer, &size, pd->data, pd->src_size);
 
 	ASSERT(res != TINF_OK);
@@ -872,6 +2171,9 @@ SUITE(tinfgzip)
 	RUN_TEST(gzip_fextra);
 	RUN_TEST(gzip_fname);
 	RUN_TEST(gzip_fcomment);
+	RUN_TEST(gzip_crc32);
+	RUN_TEST(gzip_uncompress2);
+	RUN_TEST(gzip_verify);
 
 	for (i = 0; i < ARRAY_SIZE(gzip_errors); ++i) {
 		sprintf(suffix, "%d", i);
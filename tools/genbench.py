@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2026 tinf contributors
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+"""
+Benchmark corpus generator.
+
+Generates a corpus of small compressed messages for tinfbench.
+
+The corpus starts with the four bytes 'TBC1', followed by one record per
+message. Each record is a byte giving the format (0 = raw deflate, 1 = zlib,
+2 = gzip), the compressed size and the original size as little-endian 32-bit
+values, and then the compressed data.
+"""
+
+import argparse
+import random
+import struct
+import zlib
+
+FORMATS = {'raw': 0, 'zlib': 1, 'gzip': 2}
+
+WORDS = [
+    'GET', 'POST', 'user', 'id', 'status', 'ok', 'error', 'timeout',
+    'request', 'response', 'latency', 'bytes', 'cache', 'hit', 'miss',
+    'shard', 'replica', 'leader', 'term', 'index', 'commit', 'token',
+    'session', 'trace', 'span', 'service', 'region', 'us-east', 'eu-west',
+]
+
+def make_text(rng, size):
+    """Return size bytes of log or JSON like text."""
+    out = []
+    n = 0
+    while n < size:
+        if rng.random() < 0.5:
+            line = '{"%s":%d,"%s":"%s","%s":%d}\n' % (
+                rng.choice(WORDS), rng.randrange(100000),
+                rng.choice(WORDS), rng.choice(WORDS),
+                rng.choice(WORDS), rng.randrange(1000))
+        else:
+            line = ' '.join(rng.choice(WORDS)
+                            for _ in range(rng.randrange(4, 12))) + '\n'
+        out.append(line)
+        n += len(line)
+    return ''.join(out).encode('ascii')[:size]
+
+def make_records(rng, size):
+    """Return size bytes of fixed size binary records with small fields."""
+    out = bytearray()
+    seq = rng.randrange(1 << 20)
+    while len(out) < size:
+        seq += rng.randrange(1, 4)
+        out.extend(struct.pack('<IHHBBBB', seq, rng.randrange(64),
+                               rng.randrange(8), 0, rng.randrange(3), 0, 1))
+    return bytes(out[:size])
+
+def make_far(rng, size):
+    """Return size bytes of random data repeated at distances of 8-32 KiB."""
+    out = bytearray(rng.getrandbits(8) for _ in range(min(size, 32768)))
+    while len(out) < size:
+        if rng.random() < 0.3:
+            out.extend(rng.getrandbits(8) for _ in range(rng.randrange(1, 8)))
+        else:
+            dist = rng.randrange(8192, 32769)
+            for _ in range(rng.randrange(4, 40)):
+                out.append(out[-dist])
+    return bytes(out[:size])
+
+def make_random(rng, size):
+    """Return size bytes of incompressible data."""
+    return bytes(rng.getrandbits(8) for _ in range(size))
+
+DATA = {
+    'text': make_text,
+    'records': make_records,
+    'random': make_random,
+    'far': make_far,
+}
+
+# Data kinds in a mixed corpus, far is only useful for large messages
+MIXED = ['text', 'records', 'random']
+
+def compress(data, fmt, level):
+    """Compress data in the given format."""
+    wbits = {'raw': -15, 'zlib': 15, 'gzip': 31}[fmt]
+    c = zlib.compressobj(level, zlib.DEFLATED, wbits)
+    return c.compress(data) + c.flush()
+
+def write_corpus(f, args):
+    """Write benchmark corpus to file f."""
+    rng = random.Random(args.seed)
+
+    kinds = MIXED if args.data == 'mixed' else [args.data]
+    fmts = ['raw', 'zlib'] if args.format == 'mixed' else [args.format]
+
+    f.write(b'TBC1')
+
+    for i in range(args.count):
+        # Log-uniform sizes, as small messages dominate RPC traffic
+        size = int(round(args.min_size * (args.max_size / args.min_size)
+                         ** rng.random()))
+        data = DATA[kinds[i % len(kinds)]](rng, size)
+        fmt = fmts[i % len(fmts)]
+        comp = compress(data, fmt, args.level)
+        f.write(struct.pack('<BII', FORMATS[fmt], len(comp), len(data)))
+        f.write(comp)
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='benchmark corpus generator.')
+    parser.add_argument('-n', '--count', type=int, default=4096,
+                        help='number of messages')
+    parser.add_argument('--min-size', type=int, default=100,
+                        help='minimum message size')
+    parser.add_argument('--max-size', type=int, default=4096,
+                        help='maximum message size')
+    parser.add_argument('-d', '--data', type=str,
+                        choices=['mixed'] + list(DATA), default='mixed',
+                        help='message contents')
+    parser.add_argument('-f', '--format', type=str,
+                        choices=['mixed'] + list(FORMATS), default='mixed',
+                        help='compressed format')
+    parser.add_argument('-l', '--level', type=int,
+                        choices=range(0, 10), default=6,
+                        help='compression level')
+    parser.add_argument('-s', '--seed', type=int, default=1,
+                        help='random seed')
+    parser.add_argument('outfile', type=argparse.FileType('wb'), help='output file')
+    args = parser.parse_args()
+
+    write_corpus(args.outfile, args)
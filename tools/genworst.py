@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2026 tinf contributors
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+"""
+Worst case corpus generator.
+
+Generates valid raw deflate streams that are as slow as possible to decode,
+and writes them as a tinfbench corpus (see genbench.py for the format).
+
+The streams are, in order:
+
+  0. blocks     - thousands of tiny dynamic blocks, each with HLIT = 286,
+                  HDIST = 30 and HCLEN = 19, and every code length sent
+                  without repeat codes, followed by a single literal
+  1. codelen15  - literals that all have 15-bit codes
+  2. maxdist    - matches of length 3 at distance 32768
+  3. onebit     - literals that have 1-bit codes
+"""
+
+import argparse
+import random
+import struct
+
+# Order of code length code lengths in the dynamic block header
+CLCIDX = [16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15]
+
+class BitWriter:
+    """LSB first bit writer, as used by deflate."""
+
+    def __init__(self):
+        self.data = bytearray()
+        self.tag = 0
+        self.bitcount = 0
+
+    def putbits(self, bits, num):
+        """Write num bit value, least significant bit first."""
+        self.tag |= bits << self.bitcount
+        self.bitcount += num
+        while self.bitcount >= 8:
+            self.data.append(self.tag & 0xFF)
+            self.tag >>= 8
+            self.bitcount -= 8
+
+    def putcode(self, code):
+        """Write Huffman code (value, length), most significant bit first."""
+        value, num = code
+        for i in range(num - 1, -1, -1):
+            self.putbits((value >> i) & 1, 1)
+
+    def finalize(self):
+        """Flush remaining bits and return data."""
+        if self.bitcount > 0:
+            self.data.append(self.tag & 0xFF)
+            self.tag = 0
+            self.bitcount = 0
+        return bytes(self.data)
+
+def canonical_codes(lengths):
+    """Return canonical Huffman codes (value, length) for code lengths."""
+    max_len = max(lengths)
+    bl_count = [0] * (max_len + 1)
+    for l in lengths:
+        if l:
+            bl_count[l] += 1
+    next_code = [0] * (max_len + 2)
+    code = 0
+    for bits in range(1, max_len + 1):
+        code = (code + bl_count[bits - 1]) << 1 if bits > 1 else 0
+        next_code[bits] = code
+    codes = []
+    for l in lengths:
+        if l:
+            codes.append((next_code[l], l))
+            next_code[l] += 1
+        else:
+            codes.append(None)
+    return codes
+
+def check_complete(lengths):
+    """Check code lengths form a complete prefix code."""
+    assert sum(2 ** (15 - l) for l in lengths if l) == 2 ** 15
+
+# Code length code with all 19 lengths present (13 of length 4, 6 of 5)
+CL_LENGTHS = [4] * 19
+for sym in (13, 14, 15, 16, 17, 18):
+    CL_LENGTHS[sym] = 5
+check_complete(CL_LENGTHS)
+CL_CODES = canonical_codes(CL_LENGTHS)
+
+def write_dynamic_header(bw, lit_lengths, dist_lengths):
+    """Write dynamic block header sending every code length explicitly."""
+    bw.putbits(len(lit_lengths) - 257, 5)
+    bw.putbits(len(dist_lengths) - 1, 5)
+    bw.putbits(19 - 4, 4)
+    for sym in CLCIDX:
+        bw.putbits(CL_LENGTHS[sym], 3)
+    for l in lit_lengths + dist_lengths:
+        bw.putcode(CL_CODES[l])
+
+def gen_blocks(args, rng):
+    """Many tiny dynamic blocks with maximal headers."""
+    lit_lengths = [8] * 226 + [9] * 60
+    dist_lengths = [4] * 2 + [5] * 28
+    check_complete(lit_lengths)
+    check_complete(dist_lengths)
+    lit_codes = canonical_codes(lit_lengths)
+
+    bw = BitWriter()
+    out = bytearray()
+    for i in range(args.blocks):
+        bw.putbits(1 if i == args.blocks - 1 else 0, 1)
+        bw.putbits(2, 2)
+        write_dynamic_header(bw, lit_lengths, dist_lengths)
+        lit = rng.randrange(256)
+        bw.putcode(lit_codes[lit])
+        out.append(lit)
+        bw.putcode(lit_codes[256])
+    return bw.finalize(), bytes(out)
+
+def gen_codelen15(args, rng):
+    """Literals with 15-bit codes, EOB and 257-262 take the short codes."""
+    lit_lengths = [15] * 256 + list(range(1, 8))
+    dist_lengths = [1]
+    check_complete(lit_lengths)
+    lit_codes = canonical_codes(lit_lengths)
+
+    bw = BitWriter()
+    bw.putbits(1, 1)
+    bw.putbits(2, 2)
+    write_dynamic_header(bw, lit_lengths, dist_lengths)
+    out = bytes(rng.getrandbits(8) for _ in range(args.size))
+    for lit in out:
+        bw.putcode(lit_codes[lit])
+    bw.putcode(lit_codes[256])
+    return bw.finalize(), out
+
+def gen_maxdist(args, rng):
+    """Stored block of 32768 bytes, then length 3 distance 32768 matches."""
+    hist = bytes(rng.getrandbits(8) for _ in range(32768))
+
+    bw = BitWriter()
+    bw.putbits(0, 1)
+    bw.putbits(0, 2)
+    bw.finalize()
+    data = bytearray(bw.data)
+    data.extend(struct.pack('<HH', 32768, 32768 ^ 0xFFFF))
+    data.extend(hist)
+
+    out = bytearray(hist)
+    bw = BitWriter()
+    bw.putbits(1, 1)
+    bw.putbits(1, 2)
+    for _ in range(args.size // 3):
+        # Fixed code for 257 is 0000001, distance code 29 is 11101
+        bw.putcode((1, 7))
+        bw.putcode((29, 5))
+        bw.putbits(8191, 13)
+        out.extend(out[-32768:-32765])
+    bw.putcode((0, 7))
+    data.extend(bw.finalize())
+    return bytes(data), bytes(out)
+
+def gen_onebit(args, rng):
+    """Literal 0 and EOB have 1-bit codes, so every bit is a symbol."""
+    lit_lengths = [1] + [0] * 255 + [1]
+    dist_lengths = [0]
+
+    bw = BitWriter()
+    bw.putbits(1, 1)
+    bw.putbits(2, 2)
+    write_dynamic_header(bw, lit_lengths, dist_lengths)
+    for _ in range(args.size):
+        bw.putbits(0, 1)
+    bw.putbits(1, 1)
+    return bw.finalize(), bytes(args.size)
+
+GENERATORS = [gen_blocks, gen_codelen15, gen_maxdist, gen_onebit]
+
+def write_corpus(f, args):
+    """Write worst case corpus to file f."""
+    rng = random.Random(args.seed)
+
+    f.write(b'TBC1')
+
+    for gen in GENERATORS:
+        comp, data = gen(args, rng)
+        f.write(struct.pack('<BII', 0, len(comp), len(data)))
+        f.write(comp)
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='worst case corpus generator.')
+    parser.add_argument('-b', '--blocks', type=int, default=4096,
+                        help='number of tiny dynamic blocks')
+    parser.add_argument('-n', '--size', type=int, default=1 << 20,
+                        help='decompressed size of the other streams')
+    parser.add_argument('-s', '--seed', type=int, default=1,
+                        help='random seed')
+    parser.add_argument('outfile', type=argparse.FileType('wb'), help='output file')
+    args = parser.parse_args()
+
+    write_corpus(args.outfile, args)
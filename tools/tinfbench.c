@@ -0,0 +1,564 @@
+/*
+ * tinfbench - tinf benchmark
+ *
+ * Copyright (c) 2026 tinf contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Reads a corpus written by tools/genbench.py and times decompression of
+ * each message.
+ *
+ * The latency mode records the time of every call in a histogram, and
+ * reports percentiles both with caches warm (the message was just
+ * decompressed) and cold (a large buffer was written between calls).
+ *
+ * The throughput mode times each message on its own and reports the lowest
+ * input and output rate, which is what matters for worst case inputs.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "tinf.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#  define HAVE_RDTSC 1
+#endif
+
+enum {
+	FORMAT_RAW  = 0,
+	FORMAT_ZLIB = 1,
+	FORMAT_GZIP = 2,
+	FORMAT_COUNT
+};
+
+static const char *format_names[FORMAT_COUNT] = { "raw", "zlib", "gzip" };
+
+struct message {
+	int format;
+	unsigned long src_size;
+	unsigned long org_size;
+	const unsigned char *data;
+};
+
+struct corpus {
+	unsigned char *buf;
+	struct message *msgs;
+	unsigned long count;
+	unsigned long max_size;
+};
+
+/*
+ * Histogram with log-linear buckets, in the style of HdrHistogram.
+ *
+ * Values below 2^HIST_SUB_BITS are counted exactly, above that every power
+ * of two is split into 2^HIST_SUB_BITS buckets, so the relative error of a
+ * reported value is below 1%.
+ */
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_SIZE ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+struct histogram {
+	uint64_t counts[HIST_SIZE];
+	uint64_t total;
+	uint64_t max;
+};
+
+static int use_rdtsc = 0;
+
+static volatile unsigned char thrash_sink;
+
+static unsigned long read_le32(const unsigned char *p)
+{
+	return ((unsigned long) p[0])
+	     | ((unsigned long) p[1] << 8)
+	     | ((unsigned long) p[2] << 16)
+	     | ((unsigned long) p[3] << 24);
+}
+
+static void printf_error(const char *fmt, ...)
+{
+	va_list arg;
+
+	fputs("tinfbench: ", stderr);
+
+	va_start(arg, fmt);
+	vfprintf(stderr, fmt, arg);
+	va_end(arg);
+
+	fputs("\n", stderr);
+}
+
+/* -- Corpus -- */
+
+static int load_corpus(const char *name, struct corpus *c)
+{
+	FILE *fin;
+	long len;
+	unsigned long pos, n;
+
+	memset(c, 0, sizeof(*c));
+
+	if ((fin = fopen(name, "rb")) == NULL) {
+		printf_error("unable to open corpus '%s'", name);
+		return 0;
+	}
+
+	fseek(fin, 0, SEEK_END);
+	len = ftell(fin);
+	fseek(fin, 0, SEEK_SET);
+
+	if (len < 4 || (c->buf = (unsigned char *) malloc(len)) == NULL
+	 || fread(c->buf, 1, len, fin) != (size_t) len
+	 || memcmp(c->buf, "TBC1", 4) != 0) {
+		printf_error("unable to read corpus '%s'", name);
+		fclose(fin);
+		return 0;
+	}
+
+	fclose(fin);
+
+	/* Count records */
+	for (pos = 4, n = 0; pos + 9 <= (unsigned long) len; ++n) {
+		pos += 9 + read_le32(&c->buf[pos + 1]);
+	}
+
+	if (pos != (unsigned long) len || n == 0) {
+		printf_error("corpus '%s' is malformed", name);
+		return 0;
+	}
+
+	c->msgs = (struct message *) malloc(n * sizeof(struct message));
+
+	if (c->msgs == NULL) {
+		printf_error("not enough memory");
+		return 0;
+	}
+
+	for (pos = 4; c->count < n; ++c->count) {
+		struct message *m = &c->msgs[c->count];
+
+		m->format = c->buf[pos];
+		m->src_size = read_le32(&c->buf[pos + 1]);
+		m->org_size = read_le32(&c->buf[pos + 5]);
+		m->data = &c->buf[pos + 9];
+
+		if (m->format >= FORMAT_COUNT) {
+			printf_error("corpus '%s' has unknown format %d", name, m->format);
+			return 0;
+		}
+
+		if (m->org_size > c->max_size) {
+			c->max_size = m->org_size;
+		}
+
+		pos += 9 + m->src_size;
+	}
+
+	return 1;
+}
+
+static void free_corpus(struct corpus *c)
+{
+	free(c->msgs);
+	free(c->buf);
+}
+
+/* -- Timing -- */
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+#ifdef HAVE_RDTSC
+	if (use_rdtsc) {
+		return __rdtsc();
+	}
+#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static unsigned long hist_index(uint64_t v)
+{
+	unsigned long shift = 0;
+
+	if (v < HIST_SUB_COUNT) {
+		return (unsigned long) v;
+	}
+
+	while ((v >> shift) >= 2 * HIST_SUB_COUNT) {
+		++shift;
+	}
+
+	return (shift + 1) * HIST_SUB_COUNT + (unsigned long) (v >> shift) - HIST_SUB_COUNT;
+}
+
+/* Return the midpoint of the range of values counted in bucket i */
+static uint64_t hist_value(unsigned long i)
+{
+	unsigned long shift;
+
+	if (i < HIST_SUB_COUNT) {
+		return i;
+	}
+
+	shift = i / HIST_SUB_COUNT - 1;
+
+	return ((uint64_t) (i % HIST_SUB_COUNT + HIST_SUB_COUNT) << shift)
+	     + (((uint64_t) 1 << shift) >> 1);
+}
+
+static void hist_record(struct histogram *h, uint64_t v)
+{
+	h->counts[hist_index(v)]++;
+	h->total++;
+
+	if (v > h->max) {
+		h->max = v;
+	}
+}
+
+static uint64_t hist_percentile(const struct histogram *h, double p)
+{
+	uint64_t rank = (uint64_t) (p / 100.0 * h->total + 0.5);
+	uint64_t sum = 0;
+	unsigned long i;
+
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	for (i = 0; i < HIST_SIZE; ++i) {
+		sum += h->counts[i];
+
+		if (sum >= rank) {
+			uint64_t v = hist_value(i);
+
+			return v < h->max ? v : h->max;
+		}
+	}
+
+	return h->max;
+}
+
+/* -- Benchmarks -- */
+
+static long decompress(const struct message *m, unsigned char *dest)
+{
+	unsigned long dlen = m->org_size;
+	long res;
+
+	switch (m->format) {
+	case FORMAT_RAW:
+		res = tinf_uncompress(dest, &dlen, m->data, m->src_size);
+		break;
+	case FORMAT_ZLIB:
+		res = tinf_zlib_uncompress(dest, &dlen, m->data, m->src_size);
+		break;
+	default:
+		res = tinf_gzip_uncompress(dest, &dlen, m->data, m->src_size);
+		break;
+	}
+
+	if (res == TINF_OK && dlen != m->org_size) {
+		res = TINF_DATA_ERROR;
+	}
+
+	return res;
+}
+
+/* Write every cache line of buf to evict the decompressor's working set */
+static void thrash(unsigned char *buf, unsigned long size)
+{
+	unsigned long i;
+
+	for (i = 0; i < size; i += 64) {
+		buf[i] += (unsigned char) i;
+	}
+
+	thrash_sink = buf[size / 2];
+}
+
+static void print_row(const char *mode, const char *format,
+                      const struct histogram *h)
+{
+	printf("%-5s %-5s %10llu %10llu %10llu %10llu %10llu\n",
+	       mode, format, (unsigned long long) h->total,
+	       (unsigned long long) hist_percentile(h, 50.0),
+	       (unsigned long long) hist_percentile(h, 99.0),
+	       (unsigned long long) hist_percentile(h, 99.9),
+	       (unsigned long long) h->max);
+}
+
+static int bench_latency(const struct corpus *c, unsigned long warm_calls,
+                         unsigned long cold_calls, unsigned long thrash_size)
+{
+	struct histogram *hist;
+	unsigned char *dest = NULL;
+	unsigned char *junk = NULL;
+	unsigned long i;
+	int f, retval = 0;
+
+	/* One histogram per format for warm, then one per format for cold */
+	hist = (struct histogram *) calloc(2 * FORMAT_COUNT, sizeof(*hist));
+	dest = (unsigned char *) malloc(c->max_size ? c->max_size : 1);
+	junk = (unsigned char *) calloc(thrash_size ? thrash_size : 1, 1);
+
+	if (hist == NULL || dest == NULL || junk == NULL) {
+		printf_error("not enough memory");
+		goto out;
+	}
+
+	/* Check every message decompresses before timing anything */
+	for (i = 0; i < c->count; ++i) {
+		if (decompress(&c->msgs[i], dest) != TINF_OK) {
+			printf_error("message %lu failed to decompress", i);
+			goto out;
+		}
+	}
+
+	for (i = 0; i < warm_calls; ++i) {
+		const struct message *m = &c->msgs[i % c->count];
+		uint64_t start;
+
+		decompress(m, dest);
+
+		start = now();
+		decompress(m, dest);
+		hist_record(&hist[m->format], now() - start);
+	}
+
+	for (i = 0; i < cold_calls; ++i) {
+		const struct message *m = &c->msgs[i % c->count];
+		uint64_t start;
+
+		thrash(junk, thrash_size);
+
+		start = now();
+		decompress(m, dest);
+		hist_record(&hist[FORMAT_COUNT + m->format], now() - start);
+	}
+
+	printf("%-5s %-5s %10s %10s %10s %10s %10s  (%s)\n",
+	       "cache", "api", "calls", "p50", "p99", "p99.9", "max",
+	       use_rdtsc ? "TSC ticks" : "ns");
+
+	for (f = 0; f < 2 * FORMAT_COUNT; ++f) {
+		if (hist[f].total) {
+			print_row(f < FORMAT_COUNT ? "warm" : "cold",
+			          format_names[f % FORMAT_COUNT], &hist[f]);
+		}
+	}
+
+	retval = 1;
+
+out:
+	free(junk);
+	free(dest);
+	free(hist);
+
+	return retval;
+}
+
+/*
+ * Time each message on its own, taking the fastest of at least `runs` runs
+ * (and at least 100 ms), and report the slowest message.
+ */
+static int bench_throughput(const struct corpus *c, unsigned long runs)
+{
+	unsigned char *dest = NULL;
+	double min_in = -1.0, min_out = -1.0;
+	unsigned long i, min_in_idx = 0, min_out_idx = 0;
+	int retval = 0;
+
+	dest = (unsigned char *) malloc(c->max_size ? c->max_size : 1);
+
+	if (dest == NULL) {
+		printf_error("not enough memory");
+		goto out;
+	}
+
+	printf("%6s %10s %10s %12s %12s\n",
+	       "msg", "in", "out", "in MB/s", "out MB/s");
+
+	for (i = 0; i < c->count; ++i) {
+		const struct message *m = &c->msgs[i];
+		uint64_t best = 0, total = 0;
+		unsigned long run;
+		double in_rate, out_rate;
+
+		for (run = 0; run < runs || total < 100000000u; ++run) {
+			uint64_t start = now();
+			long res = decompress(m, dest);
+			uint64_t t = now() - start;
+
+			if (res != TINF_OK) {
+				printf_error("message %lu failed to decompress", i);
+				goto out;
+			}
+
+			if (run == 0 || t < best) {
+				best = t;
+			}
+
+			total += t;
+		}
+
+		if (best == 0) {
+			best = 1;
+		}
+
+		/* Bytes per ns is GB/s, so scale to MB/s */
+		in_rate = 1000.0 * m->src_size / best;
+		out_rate = 1000.0 * m->org_size / best;
+
+		printf("%6lu %10lu %10lu %12.2f %12.2f\n",
+		       i, m->src_size, m->org_size, in_rate, out_rate);
+
+		if (min_in < 0 || in_rate < min_in) {
+			min_in = in_rate;
+			min_in_idx = i;
+		}
+
+		if (min_out < 0 || out_rate < min_out) {
+			min_out = out_rate;
+			min_out_idx = i;
+		}
+	}
+
+	printf("\nminimum input rate  %12.2f MB/s (message %lu)\n",
+	       min_in, min_in_idx);
+	printf("minimum output rate %12.2f MB/s (message %lu)\n",
+	       min_out, min_out_idx);
+
+	retval = 1;
+
+out:
+	free(dest);
+
+	return retval;
+}
+
+static void usage(void)
+{
+	fputs("usage: tinfbench latency [options] CORPUS\n"
+	      "       tinfbench throughput [options] CORPUS\n"
+	      "\n"
+	      "latency options:\n"
+	      "  -n N   number of cache-warm calls (default 1000000)\n"
+	      "  -c N   number of cache-cold calls (default 10000)\n"
+	      "  -s N   MiB written between cache-cold calls (default 32)\n"
+#ifdef HAVE_RDTSC
+	      "  -t     time using rdtsc instead of clock_gettime\n"
+#endif
+	      "\n"
+	      "throughput options:\n"
+	      "  -n N   minimum number of runs per message (default 5)\n"
+	      "\n"
+	      "Generate CORPUS with tools/genbench.py or tools/genworst.py.\n",
+	      stderr);
+}
+
+int main(int argc, char *argv[])
+{
+	struct corpus corpus;
+	unsigned long count = 0;
+	unsigned long cold_calls = 10000;
+	unsigned long thrash_size = 32;
+	const char *name = NULL;
+	int latency, i, ok;
+
+	if (argc < 3) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if (strcmp(argv[1], "latency") == 0) {
+		latency = 1;
+	}
+	else if (strcmp(argv[1], "throughput") == 0) {
+		latency = 0;
+	}
+	else {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	for (i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			count = strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+			cold_calls = strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			thrash_size = strtoul(argv[++i], NULL, 10);
+		}
+#ifdef HAVE_RDTSC
+		else if (strcmp(argv[i], "-t") == 0 && latency) {
+			use_rdtsc = 1;
+		}
+#endif
+		else if (argv[i][0] != '-' && name == NULL) {
+			name = argv[i];
+		}
+		else {
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (name == NULL) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if (!load_corpus(name, &corpus)) {
+		free_corpus(&corpus);
+		return EXIT_FAILURE;
+	}
+
+	printf("tinfbench " TINF_VER_STRING " - %lu messages from '%s'\n\n",
+	       corpus.count, name);
+
+	if (latency) {
+		ok = bench_latency(&corpus, count ? count : 1000000, cold_calls,
+		                   thrash_size * 1024 * 1024);
+	}
+	else {
+		ok = bench_throughput(&corpus, count ? count : 5);
+	}
+
+	free_corpus(&corpus);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}